@@ -0,0 +1,483 @@
+#include <inttypes.h>
+#include <ncurses.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "draw.h"
+#include "format.h"
+#include "global.h"
+#include "history.h"
+#include "lexer.h"
+#include "numberstack.h"
+#include "operators.h"
+#include "parser.h"
+#include "preview.h"
+#include "search.h"
+#include "wide.h"
+
+/*
+ * Microbenchmarks of the core kernels (make bench)
+ *
+ * Every kernel is run over a fixed corpus: the expressions below, or operands from a fixed seed.
+ * The number of operations per repetition is raised until a repetition takes at least BENCH_MIN_NS,
+ * then the kernel is warmed up and timed BENCH_REPETITIONS times. Kernels time themselves, so
+ * what they need to set up each operation isn't counted.
+ *
+ * The results are written to stdout as CSV, one line per kernel:
+ *     benchmark,median_ns,p99_ns,ops
+ * with the median and the 99th percentile of the nanoseconds per operation over all the repetitions,
+ * and the number of operations in each repetition
+ */
+
+#define BENCH_MIN_NS 200000
+#define BENCH_WARMUP 5
+#define BENCH_REPETITIONS 101
+
+// Operands of the operators and numbers to format, the first operand is always a valid shift or divisor
+#define BENCH_OPERANDS 1024
+
+// Inputs in the history that is searched
+#define BENCH_HISTORY 300000
+
+// Operands of the wide kernels, the first one is half as wide (or a valid shift)
+#define BENCH_WIDE_OPERANDS 64
+
+static const char* corpus[] = {
+    "1",
+    "255",
+    "0xff",
+    "0b1011",
+    "1+2",
+    "2*3+4",
+    "  12 + 0x34 ",
+    "(1+2)*(3+4)",
+    "0xdeadbeef & 0xffff",
+    "1 << 63 | 1",
+    "~0 >> 4",
+    "0xffffffffffffffff ^ 0x5555555555555555",
+    "((((((1+2)*3)-4)/5)%6)+7)",
+    "18446744073709551615 - 1",
+    "0b1111000011110000 | 0b0000111100001111",
+    "1+2+3+4+5+6+7+8+9+10+11+12+13+14+15+16+17+18+19+20",
+    "0x12 @ 0x34",
+    "abc+def*123",
+};
+
+#define NCORPUS ((int) (sizeof(corpus) / sizeof(corpus[0])))
+
+static char* corpus_tokens[NCORPUS];
+static exprtree corpus_trees[NCORPUS];
+
+static uint64_t operand_a[BENCH_OPERANDS];
+static uint64_t operand_b[BENCH_OPERANDS];
+
+static wide wide_a[BENCH_WIDE_OPERANDS];
+static wide wide_b[BENCH_WIDE_OPERANDS];
+
+// The operator or the kind of number the current kernel uses
+static operation* bench_op;
+static int bench_type;
+
+static numberstack* bench_numbers;
+
+// Results are added here so the kernels can't be optimized away
+static volatile uint64_t sink;
+
+// Time taken by reading the clock, removed from the kernels that read it for every operation
+static uint64_t clock_overhead_ns;
+
+static void run_benchmark(const char*, uint64_t (*)(long));
+static uint64_t now_ns();
+static int compare_ns(const void*, const void*);
+static uint64_t bench_sanitize(long);
+static uint64_t bench_parse(long);
+static uint64_t bench_calculate(long);
+static uint64_t bench_free_exprtree(long);
+static uint64_t bench_operator(long);
+static uint64_t bench_wide_operator(long);
+static uint64_t bench_format_number(long);
+static uint64_t bench_preview(long);
+static uint64_t bench_history_search(long);
+static uint64_t bench_draw(long);
+static int init_headless_gui();
+
+
+int main() {
+
+    init_operations();
+    init_lexer();
+
+    // Operands from a fixed seed (xorshift), so every run uses the same ones
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    for (int i = 0; i < BENCH_OPERANDS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        operand_a[i] = 1 + seed % 63;
+        operand_b[i] = seed;
+    }
+
+    clock_overhead_ns = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t start = now_ns();
+        uint64_t ns = now_ns() - start;
+        if (ns < clock_overhead_ns)
+            clock_overhead_ns = ns;
+    }
+
+    for (int i = 0; i < NCORPUS; i++) {
+        corpus_tokens[i] = strdup(sanitize(corpus[i], strlen(corpus[i])));
+        arena_reset(&eval_arena);
+    }
+
+    printf("benchmark,median_ns,p99_ns,ops\n");
+
+    run_benchmark("sanitize", bench_sanitize);
+    run_benchmark("parse", bench_parse);
+
+    // calculate() needs all the trees at once, so they're all kept in the arena
+    for (int i = 0; i < NCORPUS; i++)
+        corpus_trees[i] = parse(corpus_tokens[i]);
+    run_benchmark("calculate", bench_calculate);
+    arena_reset(&eval_arena);
+
+    run_benchmark("free_exprtree", bench_free_exprtree);
+
+    for (int i = 0; (bench_op = get_operation(i)) != NULL; i++) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "operator/%s", bench_op->name);
+        run_benchmark(name, bench_operator);
+    }
+
+    // Also at smaller sizes, where it swaps fewer bytes, and at an odd number of bytes
+    bench_op = getopcode(SWAPENDIANNESS_SYMBOL);
+    const int swap_bits[] = {64, 32, 24, 16};
+    for (int i = 0; i < (int) (sizeof(swap_bits) / sizeof(swap_bits[0])); i++) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "swap_endianness/%d", swap_bits[i]);
+
+        set_globalmasksize(swap_bits[i]);
+        run_benchmark(name, bench_operator);
+    }
+    set_globalmasksize(DEFAULT_MASK_SIZE);
+
+    // The kernels for 8 bits against the ones that mask for any number of bits
+    const char sized_ops[] = {ADD_SYMBOL, ROL_SYMBOL};
+    const int sized_bits[] = {8, 12};
+    for (int i = 0; i < (int) sizeof(sized_ops); i++)
+        for (int j = 0; j < (int) (sizeof(sized_bits) / sizeof(sized_bits[0])); j++) {
+
+            bench_op = getopcode(sized_ops[i]);
+
+            char name[32];
+            snprintf(name, sizeof(name), "operator/%s/%d", bench_op->name, sized_bits[j]);
+
+            set_globalmasksize(sized_bits[j]);
+            run_benchmark(name, bench_operator);
+        }
+    set_globalmasksize(DEFAULT_MASK_SIZE);
+
+    // The wide kernels at the widths of the __int128 fast path, of Karatsuba and of the widest numbers
+    const char wide_ops[] = {ADD_SYMBOL, MUL_SYMBOL, DIV_SYMBOL, SHL_SYMBOL};
+    const int wide_sizes[] = {128, 1024, WIDE_MAX_BITS};
+
+    for (int i = 0; i < (int) (sizeof(wide_sizes) / sizeof(wide_sizes[0])); i++) {
+
+        set_globalmasksize(wide_sizes[i]);
+
+        for (int j = 0; j < BENCH_WIDE_OPERANDS; j++) {
+            for (int k = 0; k < wide_limbs(); k++) {
+                wide_b[j].limbs[k] = operand_b[(j * WIDE_LIMBS + k) % BENCH_OPERANDS];
+                wide_a[j].limbs[k] = 2 * k < wide_limbs() ? operand_b[(j * WIDE_LIMBS + k + 1) % BENCH_OPERANDS] : 0;
+            }
+        }
+
+        for (int j = 0; j < (int) sizeof(wide_ops); j++) {
+
+            bench_op = getopcode(wide_ops[j]);
+
+            // Shifts by less than a limb
+            if (wide_ops[j] == SHL_SYMBOL)
+                for (int k = 0; k < BENCH_WIDE_OPERANDS; k++)
+                    wide_from_u64(&wide_a[k], operand_a[k]);
+
+            char name[32];
+            snprintf(name, sizeof(name), "wide_operator/%s/%d", bench_op->name, wide_sizes[i]);
+            run_benchmark(name, bench_wide_operator);
+        }
+    }
+    set_globalmasksize(DEFAULT_MASK_SIZE);
+
+    // The numbers shown in the history
+    const char* types[] = {"dec", "hex", "bin"};
+    for (bench_type = NTYPE_DEC; bench_type <= NTYPE_BIN; bench_type++) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "format_number/%s", types[bench_type]);
+        run_benchmark(name, bench_format_number);
+    }
+
+    run_benchmark("preview", bench_preview);
+
+    // Inputs like the ones typed, only kept in memory since there's no history file
+    for (int i = 0; i < BENCH_HISTORY; i++) {
+
+        char line[64];
+        snprintf(line, sizeof(line), "0x%" PRIx64 " ^ %d", operand_b[i % BENCH_OPERANDS] >> i % 32, i);
+        append_history_file(line);
+    }
+
+    // The index is built before it's timed
+    search_records();
+    run_benchmark("history_search", bench_history_search);
+    close_history_file();
+
+    if (init_headless_gui()) {
+        run_benchmark("draw", bench_draw);
+        endwin();
+    }
+    else
+        fprintf(stderr, "bench: no terminal description for a headless screen, draw skipped\n");
+
+    for (int i = 0; i < NCORPUS; i++)
+        free(corpus_tokens[i]);
+    free_arena(&eval_arena);
+
+    return 0;
+}
+
+/**
+ * @brief Time a kernel and write its line of results
+ *
+ * *kernel* must do the number of operations it's given, and return how many nanoseconds they took
+ */
+static void run_benchmark(const char* name, uint64_t (*kernel)(long)) {
+
+    long ops = 1;
+    while (kernel(ops) < BENCH_MIN_NS && ops < (1L << 40))
+        ops *= 2;
+
+    for (int i = 0; i < BENCH_WARMUP; i++)
+        kernel(ops);
+
+    double ns[BENCH_REPETITIONS];
+    for (int i = 0; i < BENCH_REPETITIONS; i++)
+        ns[i] = (double) kernel(ops) / ops;
+
+    qsort(ns, BENCH_REPETITIONS, sizeof(double), compare_ns);
+
+    printf("%s,%.2f,%.2f,%ld\n", name, ns[BENCH_REPETITIONS / 2], ns[BENCH_REPETITIONS * 99 / 100], ops);
+    fflush(stdout);
+}
+
+static uint64_t now_ns() {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int compare_ns(const void* a, const void* b) {
+
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t bench_sanitize(long ops) {
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++) {
+
+        const char* in = corpus[i % NCORPUS];
+        sink += *sanitize(in, strlen(in));
+
+        // Nothing else uses the arena, resetting it is only moving back to the start
+        arena_reset(&eval_arena);
+    }
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_parse(long ops) {
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++) {
+
+        sink += parse(corpus_tokens[i % NCORPUS])->type;
+        arena_reset(&eval_arena);
+    }
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_calculate(long ops) {
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++)
+        sink += calculate(corpus_trees[i % NCORPUS]);
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_free_exprtree(long ops) {
+
+    uint64_t ns = 0;
+
+    // Each tree is parsed first, only freeing it is timed
+    for (long i = 0; i < ops; i++) {
+
+        exprtree tree = parse(corpus_tokens[i % NCORPUS]);
+
+        uint64_t start = now_ns();
+        free_exprtree(tree);
+        uint64_t elapsed = now_ns() - start;
+
+        ns += elapsed > clock_overhead_ns ? elapsed - clock_overhead_ns : 0;
+    }
+
+    // At least 1ns per tree, or the number of operations would grow forever
+    return ns > (uint64_t) ops ? ns : (uint64_t) ops;
+}
+
+static uint64_t bench_operator(long ops) {
+
+    uint64_t (*execute)(uint64_t, uint64_t) = bench_op->execute[active_kernels];
+    uint64_t result = 0;
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++)
+        result ^= execute(operand_a[i % BENCH_OPERANDS], operand_b[i % BENCH_OPERANDS]);
+
+    uint64_t ns = now_ns() - start;
+
+    sink += result;
+    return ns;
+}
+
+static uint64_t bench_wide_operator(long ops) {
+
+    void (*execute)(wide*, const wide*, const wide*) = bench_op->wide_execute;
+    wide result;
+    uint64_t folded = 0;
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++) {
+        execute(&result, &wide_a[i % BENCH_WIDE_OPERANDS], &wide_b[i % BENCH_WIDE_OPERANDS]);
+        folded ^= result.limbs[0];
+    }
+
+    uint64_t ns = now_ns() - start;
+
+    sink += folded;
+    return ns;
+}
+
+static uint64_t bench_format_number(long ops) {
+
+    char buf[FORMAT_BUFFER_SIZE];
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++)
+        sink += format_number(buf, operand_b[i % BENCH_OPERANDS], bench_type);
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_preview(long ops) {
+
+    uint64_t start = now_ns();
+
+    // Each operation types one of the expressions, with the preview after every character
+    for (long i = 0; i < ops; i++) {
+
+        const char* tokens = corpus_tokens[i % NCORPUS];
+        int len = strlen(tokens);
+
+        for (int j = 1; j <= len; j++)
+            sink += preview_expression(tokens, j);
+    }
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_history_search(long ops) {
+
+    uint64_t start = now_ns();
+
+    // Each operation finds the newest input with one of the numbers, most of them far back
+    for (long i = 0; i < ops; i++) {
+
+        char query[16];
+        int len = snprintf(query, sizeof(query), "^ %ld", i * 7919 % BENCH_HISTORY);
+        sink += search_history(query, len, search_records());
+    }
+
+    return now_ns() - start;
+}
+
+static uint64_t bench_draw(long ops) {
+
+    uint64_t start = now_ns();
+
+    for (long i = 0; i < ops; i++) {
+
+        clear_numberstack(bench_numbers);
+        push_numberstack(bench_numbers, operand_b[i % BENCH_OPERANDS]);
+
+        draw(bench_numbers, i & 1 ? getopcode(ADD_SYMBOL) : NULL);
+        doupdate();
+    }
+
+    return now_ns() - start;
+}
+
+/**
+ * @brief Create the windows of the interface on a screen that writes to /dev/null, returns 0 if it can't
+ */
+static int init_headless_gui() {
+
+    FILE* out = fopen("/dev/null", "w");
+    FILE* in = fopen("/dev/null", "r");
+
+    if (out == NULL || in == NULL || newterm("xterm", out, in) == NULL)
+        return 0;
+
+    use_interface = 1;
+    getmaxyx(stdscr, wMaxY, wMaxX);
+
+    displaywin = newwin(wMaxY-3, wMaxX, 0, 0);
+    inputwin = newwin(3, wMaxX, wMaxY-3, 0);
+
+    bench_numbers = create_numberstack(4);
+
+    // A few numbers in the history, like after some input
+    init_history(&history, HISTORY_LINE_MEMORY, 0);
+    for (int i = 0; i < 8; i++)
+        add_number_to_history(operand_b[i], NTYPE_DEC);
+
+    return 1;
+}
+
+/*
+ * The benchmarks are linked with everything but main.c, which has these
+ */
+
+void exit_pcalc(int code) {
+
+    exit(code);
+}
+
+void process_prompt(struct operation** UNUSED(current_op), const char* UNUSED(prompt), size_t UNUSED(len)) {
+}
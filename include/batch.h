@@ -0,0 +1,23 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Size of the blocks read from the input and of the output buffer in batch mode
+#define BATCH_IN_SIZE (1 << 16)
+#define BATCH_OUT_SIZE (1 << 16)
+
+// Size of the chunks of input given to each worker with --jobs, and how many chunks per worker can wait
+#define BATCH_CHUNK_SIZE (1 << 20)
+#define BATCH_CHUNKS_PER_JOB 4
+
+void run_batch(FILE* in);
+void run_batch_jobs(FILE* in, int njobs);
+char* map_batch_file(const char* path, size_t* size);
+void run_batch_file(char* input, size_t size, int njobs);
+int is_command_line(const char* prompt, size_t len);
+void batch_write(const char* str, size_t len);
+void flush_batch_output();
+
+#endif
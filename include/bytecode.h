@@ -0,0 +1,57 @@
+#ifndef _BYTECODE_H
+#define _BYTECODE_H
+
+#include <stdint.h>
+
+#include "operators.h"
+#include "parser.h"
+
+// Maximum number of values on the stack of the interpreter
+#define BYTECODE_STACK_SIZE 64
+// Maximum number of values calculated at once by run_bytecode_lanes()
+#define BYTECODE_LANES 256
+
+enum opcodes {
+
+    BC_PUSH,    // Push the immediate value
+    BC_LOAD,    // Push the value of the variable
+    BC_ADD,
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_MOD,
+    BC_AND,
+    BC_OR,
+    BC_NOR,
+    BC_XOR,
+    BC_SHL,
+    BC_SHR,
+    BC_CALL,    // Any other operation with two operands, executed through operation::execute
+
+    // Operations with one operand
+    BC_NOT,
+    BC_TWOSCOMPLEMENT,
+    BC_CALL1,   // Any other operation with one operand
+
+};
+
+typedef struct instruction {
+    int opcode;
+    union {
+        uint64_t value;     // BC_PUSH
+        operation* op;      // BC_CALL
+    };
+} instruction;
+
+// An expression tree lowered to postfix order: operands are pushed and operators consume them
+typedef struct bytecode {
+    int ninstructions;
+    int depth;
+    instruction* instructions;
+} bytecode;
+
+bytecode* compile_exprtree(exprtree, arena*);
+uint64_t run_bytecode(const bytecode*);
+void run_bytecode_lanes(const bytecode*, const uint64_t* variables, uint64_t* results, int n);
+
+#endif
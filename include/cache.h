@@ -0,0 +1,34 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+
+#include "bytecode.h"
+
+struct wide;
+
+// Maximum number of compiled expressions kept, the least recently used one is evicted first
+#define CACHE_CAPACITY 512
+// Number of hash table buckets (must be a power of two)
+#define CACHE_BUCKETS 1024
+
+typedef struct cache_entry {
+    char* key;      // The sanitized tokens the program was compiled from
+    uint64_t hash;
+    int masksize;   // The globalmasksize it was compiled for
+    bytecode program;
+    struct cache_entry* next_in_bucket;
+    struct cache_entry* newer;
+    struct cache_entry* older;
+} cache_entry;
+
+extern _Thread_local unsigned long cache_hits;
+extern _Thread_local unsigned long cache_misses;
+
+uint64_t evaluate(char* tokens);
+void evaluate_wide(char* tokens, struct wide* result);
+const bytecode* lookup_cache(const char* tokens);
+void insert_cache(const char* tokens, const bytecode* program);
+void clear_cache();
+
+#endif
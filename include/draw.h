@@ -6,6 +6,20 @@
 #include "numberstack.h"
 #include "operators.h"
 
+// Operations per line in the symbols, or more when the window is wide enough (each one takes SYMBOL_WIDTH columns)
+#define SYMBOLS_PER_LINE 4
+#define SYMBOL_WIDTH 10
+
+// Bracketed paste: while it's on, the terminal sends pastes between the start and the end sequences
+#define BRACKETED_PASTE_ON "\033[?2004h"
+#define BRACKETED_PASTE_OFF "\033[?2004l"
+#define BRACKETED_PASTE_START "\033[200~"
+#define BRACKETED_PASTE_END "\033[201~"
+
+// Keys for the start and the end of a paste
+#define KEY_PASTE_START (KEY_MAX + 1)
+#define KEY_PASTE_END (KEY_MAX + 2)
+
 enum colors {
 
     COLOR_PAIR_DEFAULT,
@@ -23,13 +37,18 @@ enum colors {
 extern WINDOW* displaywin, *inputwin;
 
 extern int wMaxX, wMaxY;
-extern int operation_enabled, decimal_enabled, hex_enabled, ascii_enabled, symbols_enabled, binary_enabled, history_enabled, colors_enabled, alt_colors_enabled;
+// The panes can be toggled by commands, which batch workers run on their own copies
+extern _Thread_local int operation_enabled, decimal_enabled, hex_enabled, ascii_enabled, binary_enabled, history_enabled;
+extern _Thread_local int stats_pane_enabled;
+extern int symbols_enabled, colors_enabled, alt_colors_enabled;
 
 extern int use_interface;
 
 void init_gui();
 void draw(numberstack*, operation*);
 void update_win_borders(numberstack* numbers);
+void printpreview(const char* prompt, size_t len);
+void printsearch(const char* query, int len, int found);
 void sweepline(WINDOW*, int, int);
 void mvwprintw_colors(WINDOW* w, int y, int x, enum colors color_pair, const char* format, ...);
 void wprintw_colors(WINDOW* w, enum colors color_pair, const char* format, ...);
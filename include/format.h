@@ -0,0 +1,17 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <stdint.h>
+
+// Enough for any formatted number, including the grouped binary pane
+#define FORMAT_BUFFER_SIZE 256
+
+int format_decimal(char* buf, uint64_t value);
+int format_signed_decimal(char* buf, uint64_t value);
+int format_hex(char* buf, uint64_t value, int uppercase);
+int format_binary(char* buf, uint64_t value, int nbits);
+int format_binary_pane(char* buf, uint64_t value, int nbits);
+int format_ascii(char* buf, uint64_t value);
+int format_number(char* buf, uint64_t value, int type);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef _GLOBAL_H
 #define _GLOBAL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_IN 80
@@ -8,8 +9,10 @@
 
 #define MEM_FAIL -1
 
+struct operation;
+
 void exit_pcalc(int);
+void process_prompt(struct operation**, const char*, size_t);
 
-char *str_with_base_of_number(uint64_t, int type);
 
 #endif
@@ -3,23 +3,48 @@
 
 #include <stdint.h>
 
-#define HISTORY_RECORDS_BEFORE_REALLOC 20
+struct wide;
+
+// Longest history line drawn before it starts over
+#define MAX_HISTORY_LINE 1024
+
+// Memory of the history shown in the interface, which starts over before it fills a line,
+// and the default memory of the input history (see --history-memory)
+#define HISTORY_LINE_MEMORY (2 * MAX_HISTORY_LINE)
+#define SEARCH_HISTORY_MEMORY (64 * 1024)
 
 #define NTYPE_DEC 0
 #define NTYPE_HEX 1
 #define NTYPE_BIN 2
 
+/*
+ * A history keeps its records one after the other in a ring of *memory* bytes, allocated when
+ * the first record is added. When a new record doesn't fit, the oldest ones are dropped
+ */
 struct history {
     int size;
-    char **records;
+    char* text;             // The records, each ending with '\0'
+    int memory;             // Bytes of text
+    int* offsets;           // Where each record starts, in a ring from the oldest one at *first*
+    int max_records;
+    int first;
+    int tail;               // Where the next record goes
+    int dedup;              // Drop a record that is the same as the one before it
+    uint64_t last_hash;     // Hash and length of the newest record, for dedup
+    int last_len;
 };
 
-extern struct history searchHistory;
-extern struct history history;
+extern _Thread_local struct history searchHistory;
+extern _Thread_local struct history history;
+// Changes every time the history does, so the pane is only drawn again when it changed
+extern _Thread_local unsigned long history_version;
 
+void init_history(struct history* h, int memory, int dedup);
 void clear_history();
-void add_to_history(struct history* h,char* in);
+int add_to_history(struct history* h, const char* in);
+const char* history_get(const struct history* h, int i);
 void add_number_to_history(uint64_t n, int type);
+void add_wide_number_to_history(const struct wide* n);
 void browsehistory(char*, int, int*);
 void free_history(struct history *h);
 
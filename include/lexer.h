@@ -0,0 +1,48 @@
+#ifndef _LEXER_H
+#define _LEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "operators.h"
+
+// Character classes
+#define CHAR_DEC 0x01
+#define CHAR_HEX 0x02
+#define CHAR_BIN 0x04
+#define CHAR_TOKEN 0x08 // Kept by sanitize()
+#define CHAR_KEYWORD 0x10 // Can start the keyword of an operation
+#define CHAR_NAMED 0x20 // The character of an operation typed as a keyword
+
+#define TOK_END 0
+#define TOK_NUMBER 1
+#define TOK_OPERATOR 2
+#define TOK_LPAR 3
+#define TOK_RPAR 4
+#define TOK_VARIABLE 5
+#define TOK_WIDE_NUMBER 6   // A number with more than 64 bits
+
+typedef struct token {
+    int type;
+    int numbertype;         // DEC_TYPE, HEX_TYPE or BIN_TYPE for TOK_NUMBER and TOK_WIDE_NUMBER
+    union {
+        uint64_t value;     // TOK_NUMBER
+        const struct wide* wide_value;  // TOK_WIDE_NUMBER, in the evaluation arena
+        operation* op;      // TOK_OPERATOR
+    };
+} token;
+
+extern unsigned char char_class[256];
+extern unsigned char digit_value[256];
+
+// When set, an x that doesn't start a hex number is the variable of map mode
+extern int variables_enabled;
+
+void init_lexer();
+size_t sanitize_into(char* output, const char* input, size_t len);
+operation* keyword_at(const char* input, size_t len, size_t* pos);
+int lex(const char* input, int len, token* tokens);
+int lex_token(const char* input, int len, int pos, token* t);
+int lex_literal(const char* input, int len, uint64_t* value);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _LITERALS_H
+#define _LITERALS_H
+
+#include <stdint.h>
+
+/*
+ * Decoders for long runs of hex and binary digits
+ *
+ * Each one validates and converts a whole block of digits at once,
+ * returning 0 (and leaving *value* untouched) if any character in the block isn't a digit
+ */
+
+int decode_hex8(const char* digits, uint64_t* value);
+int decode_hex16(const char* digits, uint64_t* value);
+int decode_bin8(const char* digits, uint64_t* value);
+int decode_bin64(const char* digits, uint64_t* value);
+
+#endif
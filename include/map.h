@@ -0,0 +1,17 @@
+#ifndef _MAP_H
+#define _MAP_H
+
+#include <stdio.h>
+
+// How numbers are read and written in map mode: as text, or as raw words of the current number of bits
+#define MAP_TEXT 0
+#define MAP_RAW_LE 1
+#define MAP_RAW_BE 2
+
+// Size of the blocks of raw words read at a time, and the alignment of the word buffers
+#define MAP_RAW_IN_SIZE (1 << 16)
+#define MAP_RAW_ALIGNMENT 64
+
+void run_map(const char* expression, FILE* in, int base, int input_format, int output_format);
+
+#endif
@@ -3,18 +3,25 @@
 
 #include <stdint.h>
 
+struct wide;
+
 typedef struct numberstack {
     int max_size;
     int size;
     uint64_t * elements;
+    struct wide * wides;    // The numbers with more than 64 bits (NULL until there are any), their lowest limb is in elements
 } numberstack;
 
-extern numberstack* numbers;
+extern _Thread_local numberstack* numbers;
 
 numberstack * create_numberstack(int max_size);
 uint64_t * pop_numberstack(numberstack* s);
 uint64_t * top_numberstack(numberstack* s);
 void push_numberstack(numberstack* s, uint64_t value);
+struct wide * pop_wide_numberstack(numberstack* s);
+struct wide * top_wide_numberstack(numberstack* s);
+void push_wide_numberstack(numberstack* s, const struct wide* value);
+void mask_numberstack(numberstack* s, int previous_masksize);
 void clear_numberstack(numberstack* s);
 void free_numberstack(numberstack* s);
 
@@ -1,6 +1,7 @@
 #ifndef _OPERATORS_H
 #define _OPERATORS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define DEFAULT_MASK -1
@@ -13,8 +14,6 @@
 #   define UNUSED(x) UNUSED_##x
 #endif
 
-#define ALL_OPS "+-*/&|$^<>:;%~_@"
-
 #define OR_SYMBOL '|'
 #define NOR_SYMBOL '$'
 #define XOR_SYMBOL '^'
@@ -32,19 +31,73 @@
 #define TWOSCOMPLEMENT_SYMBOL '_'
 #define SWAPENDIANNESS_SYMBOL '@'
 
+// Operations typed as a keyword (i.e. "rev16 1") have a control character instead, which sanitize()
+// puts in place of the keyword, so the punctuation users type by habit (like "1+2=") is still dropped.
+// The characters from '\b' to '\r' are left out
+#define SWAPBYTES16_SYMBOL '\x01'
+#define SWAPBYTES32_SYMBOL '\x02'
+#define SWAPNIBBLES_SYMBOL '\x03'
+#define POPCOUNT_SYMBOL '\x04'
+#define PARITY_SYMBOL '\x05'
+#define LEADINGZEROS_SYMBOL '\x06'
+#define TRAILINGZEROS_SYMBOL '\x07'
+#define LOG2_SYMBOL '\x0e'
+#define BITREVERSE_SYMBOL '\x0f'
+#define EXTRACT_SYMBOL '\x10'
+#define DEPOSIT_SYMBOL '\x11'
+
+// Precedence of binary operators in expressions, higher binds tighter
+#define PREC_NONE 0 // Not a binary operator in expressions
+#define PREC_OR 1
+#define PREC_XOR 2
+#define PREC_AND 3
+#define PREC_SHIFT 4
+#define PREC_ADD 5
+#define PREC_MUL 6
+
+// Longest keyword of an operation
+#define MAX_KEYWORD_LEN 6
+
+#define ASSOC_LEFT 0
+#define ASSOC_RIGHT 1
+
+// Each operation has kernels for these numbers of bits, and one for any other number (see active_kernels)
+#define KERNELS_8 0
+#define KERNELS_16 1
+#define KERNELS_32 2
+#define KERNELS_64 3
+#define KERNELS_ANY 4
+#define NKERNELS 5
+
+struct wide;
+
 // Operations Control
 // Example: '+' takes two operands, therefore the noperands = 2
 typedef struct operation {
     char character;
     unsigned char noperands;
-    uint64_t (*execute) (uint64_t, uint64_t);
+    uint64_t (*execute[NKERNELS]) (uint64_t, uint64_t);     // Called as execute[active_kernels], results have the number of bits
+    void (*wide_execute) (struct wide*, const struct wide*, const struct wide*);   // With more than 64 bits (see wide.h)
+    const char* name;               // Shown in the symbols help
+    const char* keyword;            // Typed instead of the character, or NULL if the character is typed
+    unsigned char precedence;
+    unsigned char associativity;
+    unsigned char prefix;           // Can be used before an operand (i.e. -1 or ~1)
 } operation;
 
-extern uint64_t globalmask;
-extern int globalmasksize;
+extern _Thread_local uint64_t globalmask;
+extern _Thread_local int globalmasksize;
+extern _Thread_local int active_kernels;
 extern operation *current_op;
 
+void init_operations();
 operation* getopcode(char c);
+operation* get_operation(int i);
+operation* keyword_operation(const char* s, size_t len);
+int format_operation(char* out, const operation* op);
+
+void set_globalmasksize(int masksize);
+int requested_masksize(const char* prompt, size_t len);
 
 uint64_t shr(uint64_t, uint64_t);
 uint64_t ror(uint64_t, uint64_t);
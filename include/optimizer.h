@@ -0,0 +1,8 @@
+#ifndef _OPTIMIZER_H
+#define _OPTIMIZER_H
+
+#include "parser.h"
+
+exprtree optimize_exprtree(exprtree);
+
+#endif
@@ -1,12 +1,16 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
+#include <stdint.h>
+
+#include "lexer.h"
 #include "operators.h"
+#include "xmalloc.h"
 
 #define MAX_CHARS 80
 
-#define VALID_TOKENS "+-*/%&|$^~<>():;_@0123456789abcdefABCDEFx"
-#define VALID_NUMBER_INPUT "0123456789abcdefx()"
+// Valid tokens are these and the characters of all the operations
+#define VALID_OPERAND_TOKENS "()0123456789abcdefABCDEFx"
 #define VALID_DEC_SYMBOLS "0123456789"
 #define VALID_HEX_SYMBOLS "0123456789abcdefABCDEF"
 #define VALID_BIN_SYMBOLS "01"
@@ -18,33 +22,43 @@
 #define DEC_TYPE 1
 #define HEX_TYPE 2
 #define BIN_TYPE 3
+#define VAR_TYPE 4 // The variable of map mode, its value is variable_value
+#define WIDE_TYPE 5 // A number with more than 64 bits
+
+#define VARIABLE_SYMBOL 'x'
 
 typedef struct exprtree {
     int type;
     union {
         operation* op;
-        uint64_t* value;
+        uint64_t value;
+        const struct wide* wide_value;  // WIDE_TYPE
     };
     struct exprtree* left;
     struct exprtree* right;
 } * exprtree;
 
 typedef struct parser_t {
-    char* tokens;
+    token* tokens;
     int ntokens;
     int pos;
 } * parser_t;
 
-char* sanitize(const char*);
+char* sanitize(const char*, size_t);
+const char* expand_keywords(const char*);
 exprtree parse(char*);
 uint64_t calculate(exprtree);
+void calculate_wide(exprtree, struct wide*);
 void free_exprtree(exprtree);
 
-extern int total_trees_created;
-extern int total_trees_freed;
-extern int total_parsers_created;
-extern int total_parsers_freed;
-extern int total_tokens_created;
-extern int total_tokens_freed;
+extern _Thread_local arena eval_arena;
+extern _Thread_local uint64_t variable_value;
+
+extern _Thread_local int total_trees_created;
+extern _Thread_local int total_trees_freed;
+extern _Thread_local int total_parsers_created;
+extern _Thread_local int total_parsers_freed;
+extern _Thread_local int total_tokens_created;
+extern _Thread_local int total_tokens_freed;
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Maximum number of tasks waiting in each worker's deque (must be a power of two)
+#define POOL_DEQUE_SIZE 64
+#define POOL_MAX_WORKERS 256
+
+// Tasks of one worker: the owner takes them from the front, other workers steal them from the back
+typedef struct pool_deque {
+    pthread_mutex_t lock;
+    unsigned front;
+    unsigned back;
+    void* tasks[POOL_DEQUE_SIZE];
+} pool_deque;
+
+struct worker_arg;
+
+typedef struct work_pool {
+    int nworkers;
+    pthread_t* threads;
+    struct worker_arg* args;
+    pool_deque* deques;
+    unsigned next_deque;            // Deque the next task is submitted to
+
+    void (*run)(void* task);        // Called by a worker for each task
+    void (*done)();                 // Called by each worker before it exits
+
+    atomic_int pending;             // Tasks submitted and not yet taken
+    int shutdown;
+    pthread_mutex_t lock;           // Protects shutdown, workers sleep on wakeup when there are no tasks
+    pthread_cond_t wakeup;
+} work_pool;
+
+work_pool* create_pool(int nworkers, void (*run)(void*), void (*done)());
+int submit_task(work_pool* pool, void* task);
+void destroy_pool(work_pool* pool);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _PREVIEW_H
+#define _PREVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "operators.h"
+
+// Longest prompt that gets a preview, as long as get_input() allows
+#define PREVIEW_MAX_LEN MAX_IN
+// Each token pushes at most three nodes on the parser stack (a zero operand, a reduced value and an operator)
+#define PREVIEW_MAX_NODES (3 * PREVIEW_MAX_LEN)
+
+// What the parser of the preview expects next
+#define PREVIEW_OPERAND 0   // An operand, which can start with a prefix operator
+#define PREVIEW_ATOM 1      // The operand after a prefix operator
+#define PREVIEW_OPERATOR 2  // A binary operator or a right parenthesis
+#define PREVIEW_DONE 3      // Nothing, the parser stopped before the end of the tokens
+
+#define NODE_VALUE 0
+#define NODE_OPERATOR 1
+#define NODE_GROUP 2        // A left parenthesis, with the prefix operator before it
+
+// Nodes are never changed once pushed, so the stack of any earlier token is still there
+typedef struct preview_node {
+    int type;
+    union {
+        uint64_t value;     // NODE_VALUE
+        operation* op;      // NODE_OPERATOR, and the prefix operator (or NULL) of NODE_GROUP
+    };
+    int next;               // Node below it, or -1
+} preview_node;
+
+// The parser between two tokens
+typedef struct preview_state {
+    int top;                // Node at the top of the stack, or -1
+    int nnodes;             // Nodes in use, the ones after them are free
+    int mode;
+    operation* prefix;      // The prefix operator in PREVIEW_ATOM
+    int depth;              // Parentheses left open
+} preview_state;
+
+int preview_prompt(const char* prompt, size_t len, uint64_t* value);
+uint64_t preview_expression(const char* input, int len);
+
+#endif
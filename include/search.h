@@ -0,0 +1,30 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include <stdint.h>
+
+// File of the input history in the home directory, used when --history-file isn't given
+#define HISTORY_FILE_NAME ".pcalc_history"
+
+// Initial number of buckets of the trigram index (a power of two), and of ids in a new list
+#define SEARCH_INDEX_BUCKETS 4096
+#define SEARCH_POSTINGS_SIZE 4
+
+// The records that contain a trigram, oldest first
+typedef struct trigram_postings {
+    uint32_t key;           // The three characters, with SEARCH_KEY_USED set (0 is an empty bucket)
+    int size;
+    int max_size;
+    int* ids;
+} trigram_postings;
+
+#define SEARCH_KEY_USED (1u << 24)
+
+void open_history_file(const char* path);
+void append_history_file(const char* in);
+int search_history(const char* query, int len, int before);
+const char* search_record(int id, int* len);
+int search_records();
+void close_history_file();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+// Lines of the statistics report, and the size of each one
+#define STATS_LINES 6
+#define STATS_LINE_SIZE 128
+
+// Counters of one thread (batch workers add theirs to the totals when they exit)
+typedef struct pcalc_stats {
+    unsigned long allocations;      // Calls to xmalloc(), xcalloc() and xrealloc()
+    unsigned long reallocations;    // The calls to xrealloc() with a pointer
+    unsigned long frees;
+    uint64_t requested_bytes;
+    int64_t live_bytes;             // Heap memory in use, as given by malloc_usable_size()
+    int64_t peak_live_bytes;
+    unsigned long parses;           // Expressions parsed, optimized and compiled
+    uint64_t parse_ns;
+    unsigned long evaluations;      // Expressions evaluated, compiled before or not
+    uint64_t evaluate_ns;
+    int peak_history_size;
+    int peak_stack_size;
+    unsigned long stack_resizes;
+} pcalc_stats;
+
+extern _Thread_local pcalc_stats stats;
+
+// Print statistics to stderr on exit (--stats), and read the timers
+extern int stats_enabled;
+extern int stats_timers_enabled;
+
+uint64_t stats_clock();
+void merge_stats();
+void format_stats(char lines[STATS_LINES][STATS_LINE_SIZE]);
+void print_stats();
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _WIDE_H
+#define _WIDE_H
+
+#include <stdint.h>
+
+// Widest numbers the bit command allows, in bits and in 64 bit limbs
+#define WIDE_MAX_BITS 4096
+#define WIDE_LIMBS (WIDE_MAX_BITS / 64)
+
+// Products of at least this many limbs are split with Karatsuba, smaller ones are done limb by limb
+#define WIDE_KARATSUBA_LIMBS 8
+
+// Enough for any formatted wide number, the binary pane of the widest one included
+#define WIDE_FORMAT_BUFFER_SIZE (2 * WIDE_MAX_BITS)
+
+// Digits kept of a number too long for the history pane
+#define WIDE_HISTORY_DIGITS 24
+
+/*
+ * A number of more than 64 bits, least significant limb first
+ *
+ * Only the limbs that hold the current number of bits (wide_limbs()) are ever read or written,
+ * the ones after them can have anything. Up to 128 bits the kernels use unsigned __int128
+ */
+typedef struct wide {
+    uint64_t limbs[WIDE_LIMBS];
+} wide;
+
+int wide_limbs();
+void wide_from_u64(wide* w, uint64_t value);
+void wide_copy(wide* dst, const wide* src);
+void wide_mask(wide* w);
+void wide_extend(wide* w, int masksize);
+int wide_is_zero(const wide* w);
+int wide_fits_u64(const wide* w);
+void wide_literal(const char* digits, int len, int base, wide* w);
+
+int format_wide_decimal(char* buf, const wide* w);
+int format_wide_signed_decimal(char* buf, const wide* w);
+int format_wide_hex(char* buf, const wide* w, int uppercase);
+int format_wide_binary_pane(char* buf, const wide* w, int bits_per_line, int nlines);
+int elide_digits(char* buf, int len, int width);
+
+// Kernels of the operations, with the operands switched like execute() (*a* is the right operand).
+// *result* can be one of the operands
+void wide_add(wide* result, const wide* a, const wide* b);
+void wide_subtract(wide* result, const wide* a, const wide* b);
+void wide_multiply(wide* result, const wide* a, const wide* b);
+void wide_divide(wide* result, const wide* a, const wide* b);
+void wide_modulus(wide* result, const wide* a, const wide* b);
+void wide_and(wide* result, const wide* a, const wide* b);
+void wide_or(wide* result, const wide* a, const wide* b);
+void wide_nor(wide* result, const wide* a, const wide* b);
+void wide_xor(wide* result, const wide* a, const wide* b);
+void wide_shl(wide* result, const wide* a, const wide* b);
+void wide_shr(wide* result, const wide* a, const wide* b);
+void wide_rol(wide* result, const wide* a, const wide* b);
+void wide_ror(wide* result, const wide* a, const wide* b);
+void wide_not(wide* result, const wide* a, const wide* b);
+void wide_twos_complement(wide* result, const wide* a, const wide* b);
+void wide_swap_endianness(wide* result, const wide* a, const wide* b);
+void wide_swap_halfword_bytes(wide* result, const wide* a, const wide* b);
+void wide_swap_word_bytes(wide* result, const wide* a, const wide* b);
+void wide_swap_nibbles(wide* result, const wide* a, const wide* b);
+void wide_popcount(wide* result, const wide* a, const wide* b);
+void wide_parity(wide* result, const wide* a, const wide* b);
+void wide_leading_zeros(wide* result, const wide* a, const wide* b);
+void wide_trailing_zeros(wide* result, const wide* a, const wide* b);
+void wide_log2_floor(wide* result, const wide* a, const wide* b);
+void wide_bit_reverse(wide* result, const wide* a, const wide* b);
+void wide_bit_extract(wide* result, const wide* a, const wide* b);
+void wide_bit_deposit(wide* result, const wide* a, const wide* b);
+
+#endif
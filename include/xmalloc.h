@@ -5,6 +5,26 @@
 
 #include "global.h"
 
+// Default size of each block of memory an arena gets from the heap
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGNMENT 16
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) char data[];
+} arena_block;
+
+// Bump allocator: memory is taken from blocks in order and all of it is released at once
+typedef struct arena {
+    arena_block* first;
+    arena_block* current;
+} arena;
+
+extern _Thread_local int total_arena_blocks_created;
+extern _Thread_local int total_arena_blocks_freed;
+
 void* xmalloc(size_t bytes);
 void* xmalloc_with_ressources(size_t bytes, void** ressources, size_t nres);
 void* xcalloc(size_t nelem, size_t bytes);
@@ -13,5 +33,10 @@ void* xrealloc(void* pntr, size_t bytes);
 void* xrealloc_with_ressources(void* pntr, size_t bytes, void** ressources, size_t nres);
 void xfreen(void** pntrs, size_t npntrs);
 void xfree(void* pntr);
+char* xstrdup(const char* str);
+
+void* arena_alloc(arena* a, size_t bytes);
+void arena_reset(arena* a);
+void free_arena(arena* a);
 
 #endif
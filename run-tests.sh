@@ -1,4 +1,4 @@
-tests=( "number-bases" "random" "expressions" "input-formats" "corner-cases" )
+tests=( "number-bases" "random" "expressions" "input-formats" "corner-cases" "long-literals" "wide" "bytes" "bits" )
 for t in "${tests[@]}"
 do
     diff -b tests/$t.correct <(cat tests/$t.test | bin/pcalc -n) ||
@@ -7,4 +7,93 @@ do
             exit 1
         fi
 done
+
+# Map mode: the same numbers through a few expressions, in every output base
+diff -b tests/map.correct <(
+    bin/pcalc -m '(x >> 4) & 0xfff ^ 0x5a5' -B hex < tests/map.test
+    bin/pcalc -m 'x * 3 + 7' < tests/map.test
+    bin/pcalc -m '~x >> 60' -B bin < tests/map.test) ||
+    if echo "Test failed:"; then
+        echo tests/map
+        exit 1
+    fi
+
+# Raw words: the map test numbers as 32 bit big endian words, through an expression, and back from little endian words
+diff -b tests/raw.correct <(
+    bin/pcalc -m x -R be -w 32 < tests/map.test |
+    bin/pcalc -m '(x >> 4) & 0xfff ^ 0x5a5' -r be -R le -w 32 |
+    bin/pcalc -m x -r le -B hex -w 32) ||
+    if echo "Test failed:"; then
+        echo tests/raw
+        exit 1
+    fi
+
+# Lines longer than the prompt are only evaluated whole when read with --file, with or without worker threads
+for j in 1 2
+do
+    diff -b tests/long-lines.correct <(bin/pcalc -n --jobs $j --file tests/long-lines.test) ||
+        if echo "Test failed:"; then
+            echo "tests/long-lines (--jobs $j)"
+            exit 1
+        fi
+done
+
+# A pipe can't be mapped, so --file must fail instead of evaluating nothing
+echo 1 | bin/pcalc -n --file /dev/stdin 2> /dev/null &&
+    if echo "Test failed:"; then
+        echo "--file /dev/stdin"
+        exit 1
+    fi
 echo "All tests passed"
+
+# Batch mode throughput: all the tests (without the quit commands) repeated until there are enough lines
+corpus=$(mktemp)
+for i in $(seq 500)
+do
+    for t in "${tests[@]}"
+    do
+        cat tests/$t.test
+    done
+done | grep -v -x -E "quit|exit|q" > $corpus
+lines=$(wc -l < $corpus)
+output=$(mktemp)
+start=$(date +%s%N)
+bin/pcalc -n < $corpus > $output
+end=$(date +%s%N)
+echo "Batch throughput: $(( lines * 1000000000 / (end - start + 1) )) lines/sec ($lines lines)"
+
+# The same with worker threads, which must give exactly the same results
+jobs=$(( $(nproc) > 1 ? $(nproc) : 2 ))
+start=$(date +%s%N)
+cmp -s $output <(bin/pcalc -n --jobs $jobs < $corpus) ||
+    if echo "Test failed:"; then
+        echo "--jobs $jobs"
+        rm -f $corpus $output
+        exit 1
+    fi
+end=$(date +%s%N)
+echo "Batch throughput with $jobs jobs: $(( lines * 1000000000 / (end - start + 1) )) lines/sec ($lines lines)"
+
+# And reading the same input with --file
+start=$(date +%s%N)
+cmp -s $output <(bin/pcalc -n --file $corpus) ||
+    if echo "Test failed:"; then
+        echo "--file"
+        rm -f $corpus $output
+        exit 1
+    fi
+end=$(date +%s%N)
+rm -f $output
+echo "Batch throughput with --file: $(( lines * 1000000000 / (end - start + 1) )) lines/sec ($lines lines)"
+
+# Map mode throughput: the map test numbers repeated the same way
+for i in $(seq 500)
+do
+    cat tests/map.test
+done > $corpus
+lines=$(wc -l < $corpus)
+start=$(date +%s%N)
+bin/pcalc -m '(x >> 4) & 0xfff ^ 0x5a5' < $corpus > /dev/null
+end=$(date +%s%N)
+rm -f $corpus
+echo "Map throughput: $(( lines * 1000000000 / (end - start + 1) )) lines/sec ($lines lines)"
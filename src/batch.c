@@ -0,0 +1,746 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "draw.h"
+#include "global.h"
+#include "history.h"
+#include "lexer.h"
+#include "numberstack.h"
+#include "operators.h"
+#include "parser.h"
+#include "pool.h"
+#include "stats.h"
+#include "xmalloc.h"
+
+/*
+ * Batch mode is used when the interface is disabled (-n)
+ *
+ * Instead of reading one character at a time with getchar() and printing one result at a time,
+ * the input is read in large blocks and split on newlines, and all the results are written to
+ * one output buffer, which is only flushed when it gets full or when the program exits
+ *
+ * With --jobs the lines are evaluated by a pool of worker threads instead (see run_batch_jobs())
+ *
+ * With --file the input is mapped to memory instead, and every line is evaluated in place (see run_batch_file())
+ */
+
+static char outbuf[BATCH_OUT_SIZE];
+static size_t outlen = 0;
+
+// Input lines evaluated by a worker, with the results they print
+typedef struct batch_chunk {
+    char* input;            // Lines exactly as read
+    int mapped;             // The input points into the file given with --file, and lines aren't truncated
+    size_t inputlen;
+    size_t inputsize;
+    int masksize;           // Number of bits when the first line is reached
+    char* output;
+    size_t outputlen;
+    size_t outputsize;
+    int quit;               // A quit command was found, so nothing after it is evaluated
+    int done;
+    struct batch_chunk* next;
+} batch_chunk;
+
+// Chunks in input order, from the oldest one still being evaluated or written
+static batch_chunk* first_chunk = NULL;
+static batch_chunk* last_chunk = NULL;
+static int nchunks = 0;
+static int quit_written = 0;
+
+static work_pool* pool;
+static pthread_mutex_t chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t chunk_done = PTHREAD_COND_INITIALIZER;
+
+// The chunk a worker is evaluating (batch_write() keeps the results there) and its current operation
+static _Thread_local batch_chunk* worker_chunk = NULL;
+static _Thread_local operation* worker_op = NULL;
+
+// Counters of the workers, added up when they exit
+static unsigned long workers_cache_hits = 0;
+static unsigned long workers_cache_misses = 0;
+
+static int split_lines(char*, char*, char*, size_t*, int (*)(const char*, size_t));
+static void finish_lines(char*, size_t, int (*)(const char*, size_t));
+static int evaluate_lines(const char*, const char*, int, int (*)(const char*, size_t));
+static size_t prompt_length(const char*, size_t, int);
+static int evaluate_line(const char*, size_t);
+static void evaluate_chunks(batch_chunk*, FILE*, int);
+static int read_chunk(batch_chunk*, FILE*);
+static size_t find_split(batch_chunk*, FILE*);
+static size_t complete_line(batch_chunk*, FILE*, size_t);
+static size_t read_prompt(const batch_chunk*, size_t, const char**, size_t*);
+static int is_quit(const char*, size_t);
+static int matches(const char*, size_t, const char*);
+static void classify_line(const char*, size_t, int*, int*);
+static int end_masksize(const batch_chunk*);
+static batch_chunk* new_chunk(char*, size_t);
+static batch_chunk* split_chunk(batch_chunk*, size_t);
+static void submit_chunk(batch_chunk*);
+static void write_oldest_chunk();
+static void run_chunk(void*);
+static int evaluate_chunk_line(const char*, size_t);
+static void finish_worker();
+
+
+/**
+ * @brief Evaluate every line of *in* and write the results to stdout
+ *
+ * Each line is handled exactly like an input line in the interactive loop, but without touching
+ * ncurses. Never returns: the program exits when a quit command or the end of the input is found
+ */
+void run_batch(FILE* in) {
+
+    char* block = xmalloc(BATCH_IN_SIZE);
+
+    // Characters of the current line that were read in the previous block(s)
+    char line[MAX_IN + 1];
+    size_t linelen = 0;
+
+    size_t nread;
+    while ((nread = fread(block, 1, BATCH_IN_SIZE, in)) > 0)
+        split_lines(block, block + nread, line, &linelen, evaluate_line);
+
+    xfree(block);
+
+    finish_lines(line, linelen, evaluate_line);
+
+    exit_pcalc(0);
+}
+
+/**
+ * @brief Same as run_batch(), but the lines are evaluated by *njobs* threads
+ *
+ * The results depend on the state left by the lines before (the stack, the current operation and the
+ * number of bits), so the input can't be split anywhere. It is split in chunks of about BATCH_CHUNK_SIZE
+ * bytes, only before lines that start over from an empty stack: lines that clear the stack, right after
+ * lines that leave no pending operation. Only the number of bits is carried to the next chunk, and it's
+ * found by looking for bit commands, so the input is only read line by line around the splits.
+ *
+ * Every worker has its own stack, history, arena and cache, and the results of each chunk are
+ * written in input order as soon as it and all the chunks before it are done
+ */
+void run_batch_jobs(FILE* in, int njobs) {
+
+    evaluate_chunks(new_chunk(NULL, 0), in, njobs);
+}
+
+/**
+ * @brief Map the file at *path* to memory, for run_batch_file()
+ *
+ * *size* is set to the size of the file, and NULL is returned when it's empty.
+ * The program exits if the file can't be read, or isn't a regular file (a pipe has no size to map)
+ */
+char* map_batch_file(const char* path, size_t* size) {
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "pcalc: %s: %s\n", path, strerror(errno));
+        exit_pcalc(EXIT_FAILURE);
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "pcalc: %s: not a regular file\n", path);
+        exit_pcalc(EXIT_FAILURE);
+    }
+
+    *size = st.st_size;
+
+    // An empty file can't be mapped, and has no lines anyway
+    char* input = NULL;
+    if (*size > 0) {
+
+        input = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input == MAP_FAILED) {
+            fprintf(stderr, "pcalc: %s: %s\n", path, strerror(errno));
+            exit_pcalc(EXIT_FAILURE);
+        }
+
+        // The lines are read once, from start to end
+        madvise(input, *size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    return input;
+}
+
+/**
+ * @brief Same as run_batch(), but the input is a file mapped with map_batch_file()
+ *
+ * Lines are evaluated where they are in the mapping instead of being copied, and they aren't truncated
+ * to the size of the prompt. With more than one job, the chunks are parts of the mapping as well
+ */
+void run_batch_file(char* input, size_t size, int njobs) {
+
+    if (njobs > 1 && size > 0)
+        evaluate_chunks(new_chunk(input, size), NULL, njobs);
+    else
+        evaluate_lines(input, input + size, 0, evaluate_line);
+
+    exit_pcalc(0);
+}
+
+/**
+ * @brief Append *len* bytes to the output buffer, flushing it to stdout when it gets full
+ */
+void batch_write(const char* str, size_t len) {
+
+    batch_chunk* c = worker_chunk;
+    if (c != NULL) {
+
+        // In a worker, the results are kept with the chunk until it's its turn to be written
+        if (c->outputlen + len > c->outputsize) {
+            c->outputsize = 2 * (c->outputlen + len);
+            c->output = xrealloc(c->output, c->outputsize);
+        }
+
+        memcpy(c->output + c->outputlen, str, len);
+        c->outputlen += len;
+        return;
+    }
+
+    if (outlen + len > BATCH_OUT_SIZE)
+        flush_batch_output();
+
+    if (len > BATCH_OUT_SIZE) {
+        fwrite(str, 1, len, stdout);
+        return;
+    }
+
+    memcpy(outbuf + outlen, str, len);
+    outlen += len;
+}
+
+/**
+ * @brief Write everything in the output buffer to stdout
+ */
+void flush_batch_output() {
+
+    if (outlen > 0) {
+        fwrite(outbuf, 1, outlen, stdout);
+        outlen = 0;
+    }
+
+    fflush(stdout);
+}
+
+/**
+ * @brief Whether process_prompt() runs the line as a command instead of an expression
+ */
+int is_command_line(const char* prompt, size_t len) {
+
+    return is_quit(prompt, len) || matches(prompt, len, "binary") || matches(prompt, len, "hex")
+        || matches(prompt, len, "ascii") || matches(prompt, len, "decimal") || matches(prompt, len, "history")
+        || matches(prompt, len, "operation") || matches(prompt, len, "stats") || memmem(prompt, len, "bit", 3) != NULL;
+}
+
+/**
+ * @brief Call *handle* with every complete line between *start* and *end*
+ *
+ * Lines are copied to *line* and cut the way prompt_length() does, and *line* keeps
+ * the incomplete line at the end for the next block. Returns 0 as soon as *handle* does
+ */
+static int split_lines(char* start, char* end, char* line, size_t* linelen, int (*handle)(const char*, size_t)) {
+
+    char* newline;
+    while ((newline = memchr(start, '\n', end - start)) != NULL) {
+
+        size_t len = newline - start;
+        if (len > MAX_IN - *linelen)
+            len = MAX_IN - *linelen;
+
+        memcpy(line + *linelen, start, len);
+        len = prompt_length(line, *linelen + len, 1);
+
+        *linelen = 0;
+        if (!handle(line, len))
+            return 0;
+
+        start = newline + 1;
+    }
+
+    // Keep the incomplete line at the end of the block for the next one
+    size_t len = end - start;
+    if (len > MAX_IN - *linelen)
+        len = MAX_IN - *linelen;
+
+    memcpy(line + *linelen, start, len);
+    *linelen += len;
+
+    return 1;
+}
+
+/**
+ * @brief Handle the last line, which might not end with a newline
+ */
+static void finish_lines(char* line, size_t linelen, int (*handle)(const char*, size_t)) {
+
+    if (linelen > 0)
+        handle(line, prompt_length(line, linelen, 1));
+}
+
+/**
+ * @brief Call *handle* with every line between *start* and *end*, where they are
+ *
+ * Lines are cut with prompt_length(). Returns 0 as soon as *handle* does
+ */
+static int evaluate_lines(const char* start, const char* end, int truncate, int (*handle)(const char*, size_t)) {
+
+    while (start < end) {
+
+        const char* newline = memchr(start, '\n', end - start);
+        const char* lineend = newline ? newline : end;
+
+        if (!handle(start, prompt_length(start, lineend - start, truncate)))
+            return 0;
+
+        start = lineend + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Length of the line of *len* characters that is given to process_prompt()
+ *
+ * A CR at the end is removed to accept CRLF line endings. With *truncate*, the line is also cut
+ * the same way get_input() would: at the size of the prompt, and at the first NUL character
+ */
+static size_t prompt_length(const char* line, size_t len, int truncate) {
+
+    if (truncate && len > MAX_IN)
+        len = MAX_IN;
+
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+
+    return truncate ? strnlen(line, len) : len;
+}
+
+static int evaluate_line(const char* line, size_t len) {
+
+    process_prompt(&current_op, line, len);
+    draw(numbers, current_op);
+
+    return 1;
+}
+
+/**
+ * @brief Split the input starting with chunk *c* and evaluate the chunks with *njobs* workers (see run_batch_jobs())
+ */
+static void evaluate_chunks(batch_chunk* c, FILE* in, int njobs) {
+
+    pool = create_pool(njobs, run_chunk, finish_worker);
+
+    while (!quit_written) {
+
+        size_t split = find_split(c, in);
+        if (split == c->inputlen) {
+            // End of the input
+            submit_chunk(c);
+            break;
+        }
+
+        batch_chunk* next = split_chunk(c, split);
+
+        submit_chunk(c);
+        c = next;
+    }
+
+    while (first_chunk != NULL)
+        write_oldest_chunk();
+
+    destroy_pool(pool);
+
+    cache_hits += workers_cache_hits;
+    cache_misses += workers_cache_misses;
+
+    exit_pcalc(0);
+}
+
+/**
+ * @brief Read more input at the end of the chunk, returns 0 at the end of the input
+ */
+static int read_chunk(batch_chunk* c, FILE* in) {
+
+    // The rest of a mapped file is all in the chunk already
+    if (c->mapped)
+        return 0;
+
+    if (c->inputlen == c->inputsize) {
+        c->inputsize *= 2;
+        c->input = xrealloc(c->input, c->inputsize);
+    }
+
+    size_t nread = fread(c->input + c->inputlen, 1, c->inputsize - c->inputlen, in);
+    c->inputlen += nread;
+
+    return nread > 0;
+}
+
+/**
+ * @brief Read the chunk up to its size, and find the first line after it the chunk can be split at
+ *
+ * Returns the position of that line, or the length of the chunk when the input ends first
+ */
+static size_t find_split(batch_chunk* c, FILE* in) {
+
+    while (c->inputlen < BATCH_CHUNK_SIZE)
+        if (!read_chunk(c, in))
+            return c->inputlen;
+
+    // Start from the line the chunk size falls in
+    char* last_newline = memrchr(c->input, '\n', BATCH_CHUNK_SIZE);
+    size_t prev = last_newline ? (size_t) (last_newline - c->input) + 1 : 0;
+
+    for (;;) {
+
+        // Both the previous line and the next one must be complete (or end the input)
+        size_t next = complete_line(c, in, prev);
+        if (next == c->inputlen)
+            return c->inputlen;
+
+        complete_line(c, in, next);
+
+        const char* prompt;
+        size_t len;
+        int clears, leaves_no_op;
+
+        read_prompt(c, prev, &prompt, &len);
+        classify_line(prompt, len, &clears, &leaves_no_op);
+
+        if (leaves_no_op == 1) {
+
+            read_prompt(c, next, &prompt, &len);
+            classify_line(prompt, len, &clears, &leaves_no_op);
+
+            if (clears)
+                return next;
+        }
+
+        prev = next;
+    }
+}
+
+/**
+ * @brief Read until the line at *pos* is complete, returns the position of the next line
+ *
+ * At least one character of the next line is read too, so the position returned
+ * is the length of the chunk only at the end of the input
+ */
+static size_t complete_line(batch_chunk* c, FILE* in, size_t pos) {
+
+    char* newline;
+    while ((newline = memchr(c->input + pos, '\n', c->inputlen - pos)) == NULL) {
+
+        pos = c->inputlen;
+        if (!read_chunk(c, in))
+            return c->inputlen;
+    }
+
+    size_t next = newline - c->input + 1;
+    if (next == c->inputlen)
+        read_chunk(c, in);
+
+    return next;
+}
+
+/**
+ * @brief Find the line at *pos* the way it's given to process_prompt(), returns the position of the next line
+ */
+static size_t read_prompt(const batch_chunk* c, size_t pos, const char** prompt, size_t* len) {
+
+    char* newline = memchr(c->input + pos, '\n', c->inputlen - pos);
+    size_t end = newline ? (size_t) (newline - c->input) : c->inputlen;
+
+    *prompt = c->input + pos;
+    *len = prompt_length(*prompt, end - pos, !c->mapped);
+
+    return newline ? end + 1 : end;
+}
+
+static int is_quit(const char* prompt, size_t len) {
+
+    return matches(prompt, len, "quit") || matches(prompt, len, "q") || matches(prompt, len, "exit");
+}
+
+static int matches(const char* prompt, size_t len, const char* command) {
+
+    return len == strlen(command) && !memcmp(prompt, command, len);
+}
+
+/**
+ * @brief Find out how a line changes the state the next lines depend on, following process_prompt()
+ *
+ * *clears* is set if the line starts over from an empty stack when there's no current operation,
+ * and *leaves_no_op* if there's no current operation after the line
+ * (or to -1 for commands, which leave the operation as it was)
+ */
+static void classify_line(const char* prompt, size_t len, int* clears, int* leaves_no_op) {
+
+    if (is_command_line(prompt, len)) {
+        *clears = 0;
+        *leaves_no_op = -1;
+        return;
+    }
+
+    // Empty input sets the operation to none and the stack to 0
+    if (len == 0) {
+        *clears = 1;
+        *leaves_no_op = 1;
+        return;
+    }
+
+    // The first and last characters sanitize() would keep
+    int ntokens = 0;
+    unsigned char first = 0, last = 0;
+
+    for (size_t i = 0; i < len; i++) {
+
+        unsigned char c = prompt[i];
+
+        if (!(char_class[c] & CHAR_TOKEN)) {
+
+            operation* op = keyword_at(prompt, len, &i);
+            if (op == NULL)
+                continue;
+
+            // The kept first letter of the keyword was the last character
+            if (char_class[(unsigned char) op->keyword[0]] & CHAR_TOKEN)
+                ntokens--;
+            c = op->character;
+        }
+
+        if (ntokens++ == 0)
+            first = c;
+        last = c;
+    }
+
+    // An operation at the start sets the current operation, so the stack isn't cleared
+    int leading_op = ntokens > 0 && getopcode(first) && (ntokens == 1 || getopcode(first)->noperands == 2);
+
+    // A number is pushed, which completes a pending operation (the stack always has at least one number),
+    // and no operation is left if the input doesn't end with one
+    *clears = !leading_op;
+    *leaves_no_op = ntokens - leading_op > 0 && !getopcode(last);
+}
+
+/**
+ * @brief Number of bits after all the lines of the chunk, found from the bit commands in it
+ */
+static int end_masksize(const batch_chunk* c) {
+
+    int masksize = c->masksize;
+
+    const char* end = c->input + c->inputlen;
+    const char* found = c->input;
+
+    while ((found = memmem(found, end - found, "bit", 3)) != NULL) {
+
+        const char* newline = memrchr(c->input, '\n', found - c->input);
+        size_t start = newline ? (size_t) (newline - c->input) + 1 : 0;
+
+        const char* prompt;
+        size_t len;
+        found = c->input + read_prompt(c, start, &prompt, &len);
+
+        // Same as the bit command in process_prompt() (unless "bit" was cut off with the end of a long line)
+        if (memmem(prompt, len, "bit", 3) != NULL)
+            masksize = requested_masksize(prompt, len);
+    }
+
+    return masksize;
+}
+
+/**
+ * @brief Create a chunk for the lines read from the input, or for the *len* mapped bytes at *mapped_input*
+ */
+static batch_chunk* new_chunk(char* mapped_input, size_t len) {
+
+    batch_chunk* c = xmalloc(sizeof(batch_chunk));
+
+    if (mapped_input != NULL) {
+        c->input = mapped_input;
+        c->inputlen = c->inputsize = len;
+        c->mapped = 1;
+    }
+    else {
+        c->inputsize = BATCH_CHUNK_SIZE + BATCH_CHUNK_SIZE / 4;
+        c->input = xmalloc(c->inputsize);
+        c->inputlen = 0;
+        c->mapped = 0;
+    }
+
+    c->masksize = DEFAULT_MASK_SIZE;
+    c->output = NULL;
+    c->outputlen = c->outputsize = 0;
+    c->quit = 0;
+    c->done = 0;
+    c->next = NULL;
+
+    return c;
+}
+
+/**
+ * @brief Move the lines of the chunk from *split* on to a new chunk, returns the new chunk
+ */
+static batch_chunk* split_chunk(batch_chunk* c, size_t split) {
+
+    batch_chunk* next;
+
+    if (c->mapped) {
+        // Nothing to copy, the new chunk is the rest of the mapping
+        next = new_chunk(c->input + split, c->inputlen - split);
+    }
+    else {
+        next = new_chunk(NULL, 0);
+        next->inputlen = c->inputlen - split;
+        if (next->inputlen > next->inputsize) {
+            next->inputsize = next->inputlen;
+            next->input = xrealloc(next->input, next->inputsize);
+        }
+        memcpy(next->input, c->input + split, next->inputlen);
+    }
+
+    c->inputlen = split;
+    next->masksize = end_masksize(c);
+
+    return next;
+}
+
+/**
+ * @brief Give a chunk to the workers, writing the oldest ones first if too many are waiting
+ */
+static void submit_chunk(batch_chunk* c) {
+
+    if (last_chunk != NULL)
+        last_chunk->next = c;
+    else
+        first_chunk = c;
+
+    last_chunk = c;
+    nchunks++;
+
+    while (nchunks > BATCH_CHUNKS_PER_JOB * pool->nworkers)
+        write_oldest_chunk();
+
+    while (!submit_task(pool, c))
+        write_oldest_chunk();
+}
+
+/**
+ * @brief Wait for the oldest chunk to be evaluated, then write its results and free it
+ *
+ * After a chunk with a quit command, the results of the next ones are thrown away
+ */
+static void write_oldest_chunk() {
+
+    batch_chunk* c = first_chunk;
+
+    pthread_mutex_lock(&chunks_lock);
+    while (!c->done)
+        pthread_cond_wait(&chunk_done, &chunks_lock);
+    pthread_mutex_unlock(&chunks_lock);
+
+    if (!quit_written)
+        batch_write(c->output, c->outputlen);
+
+    quit_written |= c->quit;
+
+    first_chunk = c->next;
+    if (first_chunk == NULL)
+        last_chunk = NULL;
+    nchunks--;
+
+    xfree(c->output);
+    if (!c->mapped)
+        xfree(c->input);
+    xfree(c);
+}
+
+/**
+ * @brief Evaluate the lines of a chunk (run by the workers)
+ */
+static void run_chunk(void* task) {
+
+    batch_chunk* c = task;
+
+    if (numbers == NULL) {
+        // First chunk of this worker
+        numbers = create_numberstack(4);
+        init_history(&history, HISTORY_LINE_MEMORY, 0);
+        init_history(&searchHistory, SEARCH_HISTORY_MEMORY, 1);
+    }
+
+    // Start like the program does, with the number of bits the chunk starts with
+    set_globalmasksize(c->masksize);
+
+    clear_numberstack(numbers);
+    push_numberstack(numbers, 0);
+    clear_history();
+    add_to_history(&history, "0");
+
+    worker_chunk = c;
+    worker_op = NULL;
+
+    // Chunks always end with a complete line, so they're evaluated where they are
+    evaluate_lines(c->input, c->input + c->inputlen, !c->mapped, evaluate_chunk_line);
+
+    worker_chunk = NULL;
+
+    pthread_mutex_lock(&chunks_lock);
+    c->done = 1;
+    pthread_cond_broadcast(&chunk_done);
+    pthread_mutex_unlock(&chunks_lock);
+}
+
+static int evaluate_chunk_line(const char* line, size_t len) {
+
+    // The quit command is left to the main thread
+    if (is_quit(line, len)) {
+        worker_chunk->quit = 1;
+        return 0;
+    }
+
+    process_prompt(&worker_op, line, len);
+    draw(numbers, worker_op);
+
+    return 1;
+}
+
+/**
+ * @brief Release everything the worker used (run by each worker before it exits)
+ */
+static void finish_worker() {
+
+    if (numbers != NULL) {
+        free_history(&history);
+        free_history(&searchHistory);
+        free_numberstack(numbers);
+    }
+
+    free_arena(&eval_arena);
+
+    pthread_mutex_lock(&chunks_lock);
+    workers_cache_hits += cache_hits;
+    workers_cache_misses += cache_misses;
+    pthread_mutex_unlock(&chunks_lock);
+
+    clear_cache();
+
+    merge_stats();
+}
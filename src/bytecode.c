@@ -0,0 +1,262 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "operators.h"
+#include "parser.h"
+#include "xmalloc.h"
+
+static int count_instructions(exprtree);
+static int stack_depth(exprtree);
+static int emit_instructions(exprtree, instruction*, int);
+static int opcode_of(operation*);
+
+
+/**
+ * @brief Lower an expression tree into a flat array of instructions
+ *
+ * The instructions are allocated from *a*. Returns NULL if the expression needs more than
+ * BYTECODE_STACK_SIZE values on the stack, in which case it should be calculated from the tree
+ */
+bytecode* compile_exprtree(exprtree expr, arena* a) {
+
+    int depth = stack_depth(expr);
+    if (depth > BYTECODE_STACK_SIZE)
+        return NULL;
+
+    bytecode* program = arena_alloc(a, sizeof(bytecode));
+
+    program->depth = depth;
+    program->ninstructions = count_instructions(expr);
+    program->instructions = arena_alloc(a, program->ninstructions * sizeof(instruction));
+
+    emit_instructions(expr, program->instructions, 0);
+
+    return program;
+}
+
+/**
+ * @brief Calculate the value of a compiled expression
+ *
+ * Gives exactly the same result as calculate() on the tree the program was compiled from:
+ * the globalmask is applied to every value pushed and to every result, the kernels of the operations
+ * that are called apply it themselves
+ */
+uint64_t run_bytecode(const bytecode* program) {
+
+    uint64_t stack[BYTECODE_STACK_SIZE];
+    int top = -1;
+
+    const instruction* ip = program->instructions;
+    const instruction* end = ip + program->ninstructions;
+
+    for (; ip < end; ip++) {
+
+        if (ip->opcode == BC_PUSH) {
+            stack[++top] = ip->value & globalmask;
+            continue;
+        }
+
+        if (ip->opcode == BC_LOAD) {
+            stack[++top] = variable_value & globalmask;
+            continue;
+        }
+
+        // Same order as the operands popped in apply_operations(): a is the right operand, b the left one
+        uint64_t a = stack[top];
+        uint64_t value;
+
+        if (ip->opcode >= BC_NOT) {
+
+            switch (ip->opcode) {
+
+                case BC_NOT: value = ~a; break;
+                case BC_TWOSCOMPLEMENT: value = -a; break;
+                default:     stack[top] = ip->op->execute[active_kernels](a, 0); continue;
+            }
+
+            stack[top] = value & globalmask;
+            continue;
+        }
+
+        uint64_t b = stack[--top];
+
+        switch (ip->opcode) {
+
+            case BC_ADD: value = b + a; break;
+            case BC_SUB: value = b - a; break;
+            case BC_MUL: value = b * a; break;
+            case BC_DIV: value = a ? b / a : 0; break;
+            case BC_MOD: value = a ? b % a : 0; break;
+            case BC_AND: value = b & a; break;
+            case BC_OR:  value = b | a; break;
+            case BC_NOR: value = ~(b | a); break;
+            case BC_XOR: value = b ^ a; break;
+            case BC_SHL: value = b << a; break;
+            case BC_SHR: value = b >> a; break;
+            default:     stack[top] = ip->op->execute[active_kernels](a, b); continue;
+        }
+
+        stack[top] = value & globalmask;
+    }
+
+    return stack[0];
+}
+
+/**
+ * @brief Calculate a compiled expression for *n* values of the variable at once (at most BYTECODE_LANES)
+ *
+ * Each value is a lane, and every instruction is applied to all the lanes before the next one,
+ * so the interpreter is dispatched once per instruction instead of once per instruction and value,
+ * and the simple operators become loops over arrays the compiler can vectorize.
+ * results[i] is what run_bytecode() gives with variable_value = variables[i]
+ */
+void run_bytecode_lanes(const bytecode* program, const uint64_t* variables, uint64_t* results, int n) {
+
+    static _Thread_local uint64_t lanes[BYTECODE_STACK_SIZE][BYTECODE_LANES];
+    int top = -1;
+
+    const uint64_t mask = globalmask;
+
+    const instruction* ip = program->instructions;
+    const instruction* end = ip + program->ninstructions;
+
+    for (; ip < end; ip++) {
+
+        if (ip->opcode == BC_PUSH) {
+            uint64_t value = ip->value & mask;
+            uint64_t* restrict r = lanes[++top];
+            for (int i = 0; i < n; i++)
+                r[i] = value;
+            continue;
+        }
+
+        if (ip->opcode == BC_LOAD) {
+            uint64_t* restrict r = lanes[++top];
+            for (int i = 0; i < n; i++)
+                r[i] = variables[i] & mask;
+            continue;
+        }
+
+        // The result replaces the left operand (or the only one) on the stack, a is the right operand
+        uint64_t* restrict a = lanes[top];
+
+        // Operations without an opcode of their own are called, their kernels give masked results
+        uint64_t (*execute)(uint64_t, uint64_t) = ip->op->execute[active_kernels];
+
+        if (ip->opcode >= BC_NOT) {
+
+            switch (ip->opcode) {
+
+                case BC_NOT:
+                    for (int i = 0; i < n; i++) a[i] = ~a[i] & mask;
+                    break;
+                case BC_TWOSCOMPLEMENT:
+                    for (int i = 0; i < n; i++) a[i] = -a[i] & mask;
+                    break;
+                default:
+                    for (int i = 0; i < n; i++) a[i] = execute(a[i], 0);
+                    break;
+            }
+
+            continue;
+        }
+
+        uint64_t* restrict b = lanes[--top];
+
+        // Shift amounts are taken modulo 64, like the scalar shift instruction does
+        switch (ip->opcode) {
+
+            case BC_ADD: for (int i = 0; i < n; i++) b[i] = (b[i] + a[i]) & mask; break;
+            case BC_SUB: for (int i = 0; i < n; i++) b[i] = (b[i] - a[i]) & mask; break;
+            case BC_MUL: for (int i = 0; i < n; i++) b[i] = (b[i] * a[i]) & mask; break;
+            case BC_DIV: for (int i = 0; i < n; i++) b[i] = a[i] ? b[i] / a[i] & mask : 0; break;
+            case BC_MOD: for (int i = 0; i < n; i++) b[i] = a[i] ? b[i] % a[i] & mask : 0; break;
+            case BC_AND: for (int i = 0; i < n; i++) b[i] = b[i] & a[i]; break;
+            case BC_OR:  for (int i = 0; i < n; i++) b[i] = b[i] | a[i]; break;
+            case BC_NOR: for (int i = 0; i < n; i++) b[i] = ~(b[i] | a[i]) & mask; break;
+            case BC_XOR: for (int i = 0; i < n; i++) b[i] = b[i] ^ a[i]; break;
+            case BC_SHL: for (int i = 0; i < n; i++) b[i] = (b[i] << (a[i] & 63)) & mask; break;
+            case BC_SHR: for (int i = 0; i < n; i++) b[i] = b[i] >> (a[i] & 63); break;
+            default:     for (int i = 0; i < n; i++) b[i] = execute(a[i], b[i]); break;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        results[i] = lanes[0][i];
+}
+
+static int count_instructions(exprtree expr) {
+
+    if (expr->type != OP_TYPE)
+        return 1;
+
+    // The left operand of a 1 operand operation isn't used, so it isn't compiled
+    if (expr->op->noperands == 1)
+        return count_instructions(expr->right) + 1;
+
+    return count_instructions(expr->left) + count_instructions(expr->right) + 1;
+}
+
+static int stack_depth(exprtree expr) {
+
+    if (expr->type != OP_TYPE)
+        return 1;
+
+    if (expr->op->noperands == 1)
+        return stack_depth(expr->right);
+
+    // The left value stays on the stack while the right one is calculated
+    int left = stack_depth(expr->left);
+    int right = stack_depth(expr->right) + 1;
+
+    return left > right ? left : right;
+}
+
+/**
+ * @brief Write the instructions of *expr* in postfix order starting at *pos*, returns the next position
+ */
+static int emit_instructions(exprtree expr, instruction* instructions, int pos) {
+
+    if (expr->type == VAR_TYPE) {
+
+        instructions[pos].opcode = BC_LOAD;
+        return pos + 1;
+    }
+
+    if (expr->type != OP_TYPE) {
+
+        instructions[pos].opcode = BC_PUSH;
+        instructions[pos].value = expr->value;
+        return pos + 1;
+    }
+
+    if (expr->op->noperands == 2)
+        pos = emit_instructions(expr->left, instructions, pos);
+    pos = emit_instructions(expr->right, instructions, pos);
+
+    instructions[pos].opcode = opcode_of(expr->op);
+    instructions[pos].op = expr->op;
+    return pos + 1;
+}
+
+static int opcode_of(operation* op) {
+
+    switch (op->character) {
+
+        case ADD_SYMBOL: return BC_ADD;
+        case SUB_SYMBOL: return BC_SUB;
+        case MUL_SYMBOL: return BC_MUL;
+        case DIV_SYMBOL: return BC_DIV;
+        case MOD_SYMBOL: return BC_MOD;
+        case AND_SYMBOL: return BC_AND;
+        case OR_SYMBOL:  return BC_OR;
+        case NOR_SYMBOL: return BC_NOR;
+        case XOR_SYMBOL: return BC_XOR;
+        case SHL_SYMBOL: return BC_SHL;
+        case SHR_SYMBOL: return BC_SHR;
+        case NOT_SYMBOL: return BC_NOT;
+        case TWOSCOMPLEMENT_SYMBOL: return BC_TWOSCOMPLEMENT;
+        default:         return op->noperands == 1 ? BC_CALL1 : BC_CALL;
+    }
+}
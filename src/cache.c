@@ -0,0 +1,241 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "cache.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "stats.h"
+#include "wide.h"
+#include "xmalloc.h"
+
+/*
+ * Compiled expression cache
+ *
+ * Expressions are compiled once and the program is kept in a hash table keyed by the sanitized
+ * tokens and the number of bits they were compiled for, so evaluating the same tokens again
+ * skips parsing and compiling altogether.
+ *
+ * All entries are also kept in a list from the most to the least recently used,
+ * when the cache is full the entry at the end of the list is reused for the new expression.
+ */
+
+_Thread_local unsigned long cache_hits = 0;
+_Thread_local unsigned long cache_misses = 0;
+
+static _Thread_local cache_entry entries[CACHE_CAPACITY];
+static _Thread_local int nentries = 0;
+
+static _Thread_local cache_entry* buckets[CACHE_BUCKETS];
+
+static _Thread_local cache_entry* newest = NULL;
+static _Thread_local cache_entry* oldest = NULL;
+
+static uint64_t hash_tokens(const char*, int);
+static void unlink_lru(cache_entry*);
+static void link_lru(cache_entry*);
+static void remove_from_bucket(cache_entry*);
+
+
+/**
+ * @brief Calculate the value of the sanitized tokens
+ *
+ * Uses the cached program when the same tokens were compiled before,
+ * otherwise parses, optimizes and compiles them and caches the result.
+ * Like parse(), everything in the evaluation arena is released afterwards
+ */
+uint64_t evaluate(char* tokens) {
+
+    uint64_t result;
+    uint64_t start = stats_clock();
+
+    stats.evaluations++;
+
+    const bytecode* cached = lookup_cache(tokens);
+    if (cached != NULL) {
+
+        result = run_bytecode(cached);
+
+        // The tokens aren't parsed, so they must be released here
+        arena_reset(&eval_arena);
+        total_tokens_freed++;
+
+        stats.evaluate_ns += stats_clock() - start;
+        return result;
+    }
+
+    exprtree expression = optimize_exprtree(parse(tokens));
+
+    // Expressions too deep for the interpreter are calculated from the tree and not cached
+    bytecode* program = compile_exprtree(expression, &eval_arena);
+
+    uint64_t parsed = stats_clock();
+    stats.parses++;
+    stats.parse_ns += parsed - start;
+
+    if (program != NULL) {
+
+        // The tokens are still in the arena until the expression is freed
+        insert_cache(tokens, program);
+        result = run_bytecode(program);
+    }
+    else
+        result = calculate(expression);
+
+    free_exprtree(expression);
+
+    stats.evaluate_ns += stats_clock() - parsed;
+    return result;
+}
+
+/**
+ * @brief Calculate the value of the sanitized tokens into *result*, when numbers have more than 64 bits
+ *
+ * The bytecode only has 64 bit registers, so the tree is calculated every time and nothing is cached
+ */
+void evaluate_wide(char* tokens, wide* result) {
+
+    uint64_t start = stats_clock();
+
+    stats.evaluations++;
+
+    exprtree expression = parse(tokens);
+
+    uint64_t parsed = stats_clock();
+    stats.parses++;
+    stats.parse_ns += parsed - start;
+
+    calculate_wide(expression, result);
+
+    free_exprtree(expression);
+
+    stats.evaluate_ns += stats_clock() - parsed;
+}
+
+/**
+ * @brief Find the program compiled from *tokens*, or NULL if it isn't cached
+ */
+const bytecode* lookup_cache(const char* tokens) {
+
+    uint64_t hash = hash_tokens(tokens, globalmasksize);
+
+    for (cache_entry* e = buckets[hash & (CACHE_BUCKETS - 1)]; e != NULL; e = e->next_in_bucket) {
+
+        if (e->hash == hash && e->masksize == globalmasksize && !strcmp(e->key, tokens)) {
+
+            // Move to the front of the LRU list
+            unlink_lru(e);
+            link_lru(e);
+
+            cache_hits++;
+            return &e->program;
+        }
+    }
+
+    cache_misses++;
+    return NULL;
+}
+
+/**
+ * @brief Keep a copy of *program* compiled from *tokens*, evicting the least recently used entry if full
+ */
+void insert_cache(const char* tokens, const bytecode* program) {
+
+    cache_entry* e;
+
+    if (nentries < CACHE_CAPACITY) {
+
+        e = &entries[nentries++];
+        e->key = NULL;
+        e->program.instructions = NULL;
+    }
+    else {
+
+        // Reuse the memory of the evicted entry
+        e = oldest;
+        unlink_lru(e);
+        remove_from_bucket(e);
+    }
+
+    size_t keylen = strlen(tokens) + 1;
+    e->key = xrealloc(e->key, keylen);
+    memcpy(e->key, tokens, keylen);
+    e->hash = hash_tokens(tokens, globalmasksize);
+    e->masksize = globalmasksize;
+
+    size_t size = program->ninstructions * sizeof(instruction);
+    e->program.instructions = xrealloc(e->program.instructions, size);
+    memcpy(e->program.instructions, program->instructions, size);
+    e->program.ninstructions = program->ninstructions;
+    e->program.depth = program->depth;
+
+    cache_entry** bucket = &buckets[e->hash & (CACHE_BUCKETS - 1)];
+    e->next_in_bucket = *bucket;
+    *bucket = e;
+
+    link_lru(e);
+}
+
+/**
+ * @brief Forget all the cached programs
+ *
+ * Programs only depend on the tokens and the globalmasksize, which are both part of the key,
+ * so this is only needed to release the memory
+ */
+void clear_cache() {
+
+    for (int i = 0; i < nentries; i++) {
+        xfree(entries[i].key);
+        xfree(entries[i].program.instructions);
+    }
+
+    nentries = 0;
+    memset(buckets, 0, sizeof(buckets));
+    newest = oldest = NULL;
+}
+
+static uint64_t hash_tokens(const char* tokens, int masksize) {
+
+    // FNV-1a, starting with the number of bits
+    uint64_t hash = (0xcbf29ce484222325ull ^ masksize) * 0x100000001b3ull;
+    for (; *tokens; tokens++) {
+        hash ^= (unsigned char) *tokens;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void unlink_lru(cache_entry* e) {
+
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        newest = e->older;
+
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        oldest = e->newer;
+}
+
+static void link_lru(cache_entry* e) {
+
+    e->newer = NULL;
+    e->older = newest;
+
+    if (newest)
+        newest->newer = e;
+    else
+        oldest = e;
+
+    newest = e;
+}
+
+static void remove_from_bucket(cache_entry* e) {
+
+    cache_entry** pe = &buckets[e->hash & (CACHE_BUCKETS - 1)];
+    while (*pe != e)
+        pe = &(*pe)->next_in_bucket;
+
+    *pe = e->next_in_bucket;
+}
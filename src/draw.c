@@ -1,43 +1,67 @@
 #include <ncurses.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
 #include "draw.h"
+#include "format.h"
 #include "history.h"
 #include "numberstack.h"
 #include "operators.h"
 #include "parser.h"
+#include "preview.h"
+#include "stats.h"
+#include "wide.h"
 
 WINDOW* displaywin, * inputwin;
 
-// ASCII control characters
-const char* ctrl_chars[] = { "NUL", "SOH", "STX", "ETX", "EOT", "ENQ", "ACK", 
-	"BEL", "BS", "HT", "LF", "VT", "FF", "CR", "SO", "SI", "DLE", "DC1", "DC2",
-	"DC3", "DC4", "NAK", "SYN", "ETB", "CAN", "EM", "SUB", "ESC", "FS", "GS", 
-	"RS", "US", "SPACE"};
-
 int wMaxX;
 int wMaxY;
 
-int operation_enabled = 1;
-int decimal_enabled = 1;
-int hex_enabled = 1;
-int ascii_enabled = 1;
+_Thread_local int operation_enabled = 1;
+_Thread_local int decimal_enabled = 1;
+_Thread_local int hex_enabled = 1;
+_Thread_local int ascii_enabled = 1;
 int symbols_enabled = 1;
-int binary_enabled = 1;
-int history_enabled = 1;
+_Thread_local int binary_enabled = 1;
+_Thread_local int history_enabled = 1;
+_Thread_local int stats_pane_enabled = 0;
 int colors_enabled = 0;
 int alt_colors_enabled = 0;
 
 int use_interface = 1;
 
-static void printbinary(uint64_t, int);
+// What the panes showed when they were last drawn, a pane is only drawn again when what it shows changes
+static struct {
+    int layout;                     // The panes that are enabled (see pane_layout()), or -1 to draw everything
+    int operation;
+    uint64_t value;                 // Top of the stack, shown by the decimal, hex and ASCII panes
+    uint64_t binary;
+    int masksize;
+    int wide;                       // Bits of the value when it had more than 64, so it's in *wide_value*, or 0
+    wide wide_value;                // The wide_limbs() limbs of the value, only when *wide* is set
+    unsigned long history_version;
+    int stats;                      // The stats pane is in place of the symbols
+} drawn = { .layout = -1 };
+
+static void printbinary(const char*, int, int);
+static int wide_bits_per_line();
 static void printhistory(numberstack*, int);
+static void printsymbols();
+static int symbol_lines();
+static int symbols_per_line();
+static void printstats();
+static int pane_layout();
+static void sweeplines(WINDOW*, int, int);
 
 void init_gui() {
 
     if (use_interface) {
 
+        // New windows are empty
+        drawn.layout = -1;
+
         initscr();
         /* Only use colors if set so and if available */
         if (colors_enabled && has_colors() == true) {
@@ -56,6 +80,15 @@ void init_gui() {
             colors_enabled = 0;
         }
         cbreak();
+        noecho();
+
+        // Escape sequences are only waited for a little, a single escape isn't a key anyway
+        set_escdelay(25);
+
+        // Pastes come between brackets, as two keys of their own
+        define_key(BRACKETED_PASTE_START, KEY_PASTE_START);
+        define_key(BRACKETED_PASTE_END, KEY_PASTE_END);
+        putp(BRACKETED_PASTE_ON);
 
         getmaxyx(stdscr, wMaxY, wMaxX);
 
@@ -63,15 +96,11 @@ void init_gui() {
         refresh();
 
         box(displaywin, ' ', 0);
-        if (symbols_enabled) {
-
-            mvwprintw_colors(displaywin, wMaxY-8, 2, COLOR_PAIR_SYMBOLS, "ADD  +    SUB  -    MUL  *    DIV  /\n");
-            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "  MOD  %%    AND  &    OR   |    NOR  $\n");
-            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "  XOR  ^    NOT  ~    SL   <    SR   >\n");
-            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "  RL   :    RR   ;    2's  _    SE   @");
-        }
+        if (symbols_enabled)
+            printsymbols();
         wrefresh(displaywin);
         inputwin = newwin(3, wMaxX, wMaxY-3, 0);
+        keypad(inputwin, TRUE);
         refresh();
         box(inputwin, ' ', 0);
         wrefresh(inputwin);
@@ -80,86 +109,166 @@ void init_gui() {
 
 }
 
-static void printbinary(uint64_t value, int priority) {
+static void printsymbols() {
 
-    uint64_t mask = ((uint64_t) 1) << (globalmasksize - 1); // Mask starts at the last bit to display, and is >> until the end
+    // Name and symbol of every operation, symbols_per_line() per line at the bottom of the display window
+    wmove(displaywin, wMaxY-4-symbol_lines(), 0);
 
-    int i=DEFAULT_MASK_SIZE-globalmasksize;
+    int per_line = symbols_per_line();
 
-    mvwprintw_colors(displaywin, 8-priority, 2, COLOR_PAIR_BINARY, "Binary:    \n         %02d  ", globalmasksize); // %s must be a 2 digit number
+    for (int i = 0; get_operation(i) != NULL; i++) {
 
-    for (; i<64; i++, mask>>=1) {
+        operation* op = get_operation(i);
 
-        uint64_t bitval = value & mask;
-        wprintw_colors(displaywin,
-            (alt_colors_enabled && bitval) ? COLOR_PAIR_BINARY_ALT : COLOR_PAIR_BINARY,
-            "%c", bitval ? '1' : '0');
+        if (i % per_line == 0)
+            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, i ? "\n  " : "  ");
+        else
+            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "    ");
 
-        if (i%16 == 15 && 64 - ((i/16+1)*16))
-            // TODO: Explain these numbers better (and decide if to keep them)
-            wprintw_colors(displaywin, COLOR_PAIR_BINARY,"\n         %d  ", 64-((i/16)+1)*16);
-        else if (i%8 == 7)
-            wprintw_colors(displaywin, COLOR_PAIR_BINARY, "   ");
-        else if (i%4 == 3)
-            wprintw_colors(displaywin, COLOR_PAIR_BINARY, "  ");
+        // An operation with a keyword is shown as the keyword, which takes the place of the name
+        if (op->keyword != NULL)
+            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "%-*s", MAX_KEYWORD_LEN, op->keyword);
         else
-            waddch(displaywin, ' ');
+            wprintw_colors(displaywin, COLOR_PAIR_SYMBOLS, "%-4s %c", op->name, op->character);
+    }
+}
+
+static int symbol_lines() {
+
+    int noperations = 0;
+    while (get_operation(noperations) != NULL)
+        noperations++;
+
+    return (noperations + symbols_per_line() - 1) / symbols_per_line();
+}
+
+/**
+ * @brief As many operations as fit in a line of the window, so the symbols don't take more lines than needed
+ */
+static int symbols_per_line() {
+
+    int fit = (wMaxX - 2) / SYMBOL_WIDTH;
+
+    return fit > SYMBOLS_PER_LINE ? fit : SYMBOLS_PER_LINE;
+}
+
+static void printstats() {
+
+    // The statistics take the place of the symbols, as many lines as fit
+    int nlines = symbol_lines();
+
+    char lines[STATS_LINES][STATS_LINE_SIZE];
+    format_stats(lines);
+
+    for (int i = 0; i < nlines; i++) {
+
+        sweepline(displaywin, wMaxY-4-nlines+i, 0);
+
+        if (i < STATS_LINES)
+            mvwprintw_colors(displaywin, wMaxY-4-nlines+i, 2, COLOR_PAIR_SYMBOLS, "%.*s", wMaxX-4, lines[i]);
+    }
+}
+
+/**
+ * @brief Print a formatted binary pane, whose lines start with a label of *labelwidth* characters
+ */
+static void printbinary(const char* pane, int labelwidth, int priority) {
+
+    mvwprintw_colors(displaywin, 8-priority, 2, COLOR_PAIR_BINARY, "Binary:    \n         ");
+
+    if (!alt_colors_enabled) {
+        wprintw_colors(displaywin, COLOR_PAIR_BINARY, "%s", pane);
+        return;
+    }
+
+    // Print runs of the same color: set bits in the alternative color, everything else (labels included) in the normal one
+    wprintw_colors(displaywin, COLOR_PAIR_BINARY, "%.*s", labelwidth, pane);
+
+    for (const char* s = pane + labelwidth; *s; ) {
+
+        int len;
+
+        if (*s == '1') {
+            len = strspn(s, "1");
+            wprintw_colors(displaywin, COLOR_PAIR_BINARY_ALT, "%.*s", len, s);
+        }
+        else {
+            // A new line starts with the indentation and the label
+            int skip = *s == '\n' ? 10 + labelwidth : 0;
+            len = skip + strcspn(s + skip, "1\n");
+            wprintw_colors(displaywin, COLOR_PAIR_BINARY, "%.*s", len, s);
+        }
 
+        s += len;
     }
 }
 
 static void printhistory(numberstack* numbers, int priority) {
-    int currY,currX;
-    mvwprintw_colors(displaywin, 14-priority, 2, COLOR_PAIR_HISTORY, "History:   ");
+
+    // The whole line is joined first and printed at once
+    char line[MAX_HISTORY_LINE];
+    int len = 0;
+    int x = 2 + strlen("History:   ");
+
     for (int i=0; i<history.size; i++) {
-        getyx(displaywin,currY,currX);
-        if(currX >= wMaxX-3 || currY > 14) {
+
+        int reclen = strlen(history_get(&history, i));
+
+        if (x >= wMaxX-3 || len + reclen + 1 >= MAX_HISTORY_LINE) {
+            // Line is full, start over with the current number
             clear_history();
-            uint64_t aux = *top_numberstack(numbers);
-            add_number_to_history(aux, 0);
+            if (globalmasksize > DEFAULT_MASK_SIZE)
+                add_wide_number_to_history(top_wide_numberstack(numbers));
+            else {
+                uint64_t aux = *top_numberstack(numbers);
+                add_number_to_history(aux, 0);
+            }
+
+            len = 0;
+            reclen = strlen(history_get(&history, 0));
+            i = history.size - 1;
         }
-        wprintw_colors(displaywin, COLOR_PAIR_HISTORY, "%s ", history.records[i]);
+
+        memcpy(line + len, history_get(&history, i), reclen);
+        len += reclen;
+        line[len++] = ' ';
+        x += reclen + 1;
     }
+
+    line[len] = '\0';
+    mvwprintw_colors(displaywin, 14-priority, 2, COLOR_PAIR_HISTORY, "History:   %s", line);
 }
 
-static void display_ascii_hex(uint64_t value, int priority) {
-	// ASCII not enabled, just display HEX
-	// Or ASCII out of range
-	if ((hex_enabled && !ascii_enabled) || value > 127) {
-		mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "Hex:       0x%llX", value);
-		return;
-	}
-	
-	// HEX not enabled, just display ASCII 
-	if (!hex_enabled && ascii_enabled) {
-		// Display control characters
-		if (value < 33) {
-			mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "ASCII:      %s", ctrl_chars[value]);
-		}
-		// Display DEL (Dec: 127)
-		else if (value == 127) {
-			mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "ASCII:      DEL");
-		}
-		// Display printable characters
-		else {
-			mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "ASCII:      %c", (uint8_t)value);
-		}
-		return;
-	}
-	
-	// Both ASCII and HEX enabled
-	// Display control characters 
-	if (value < 33) {
-		mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "Hex:       0x%llX		ASCII:      %s", value, ctrl_chars[value]);
-	}
-	// Display DEL (Dec: 127)
-	else if (value == 127) {
-		mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "Hex:       0x7F		ASCII:      DEL");
-	}
-	else {
-		// Display printable characters
-		mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "Hex:       0x%llX		ASCII:      %c", value, (uint8_t)value);
-	}
+static void display_ascii_hex(uint64_t value, const wide* w, int priority) {
+
+    char pane[WIDE_FORMAT_BUFFER_SIZE];
+    int len = 0;
+
+    // A number of more than 64 bits is only a character when its value is in *value*
+    int ascii = value <= 127 && (w == NULL || wide_fits_u64(w));
+
+    // Hex is shown when enabled, or in place of ASCII when out of range
+    if (hex_enabled || !ascii) {
+        memcpy(pane, "Hex:       0x", 13);
+        if (w != NULL)
+            len = 13 + elide_digits(pane + 13, format_wide_hex(pane + 13, w, 1), wMaxX - 17);
+        else
+            len = 13 + format_hex(pane + 13, value, 1);
+    }
+
+    if (ascii_enabled && ascii) {
+        if (len) {
+            memcpy(pane + len, "\t\t", 2);
+            len += 2;
+        }
+        memcpy(pane + len, "ASCII:      ", 12);
+        len += 12;
+        format_ascii(pane + len, value);
+    }
+    else
+        pane[len] = '\0';
+
+    mvwprintw_colors(displaywin, priority, 2, COLOR_PAIR_HEX, "%s", pane);
 }
 
 
@@ -171,47 +280,193 @@ void draw(numberstack* numbers, operation* current_op) {
     if (np == NULL) n = 0;
     else n = *np;
 
+    // With more than 64 bits, n is only the lowest limb of the number
+    wide zero;
+    const wide* w = NULL;
+    if (globalmasksize > DEFAULT_MASK_SIZE) {
+        w = top_wide_numberstack(numbers);
+        if (w == NULL) {
+            wide_from_u64(&zero, 0);
+            w = &zero;
+        }
+    }
+
     if (use_interface) {
 
         int prio = 0; // Priority
 
-        // Clear lines
-        for(int i = 2 ; i < 16 ; i++) {
-            sweepline(displaywin, i, 0);
+        // When panes are toggled the others move, so everything is drawn again
+        int layout = pane_layout();
+        int all = layout != drawn.layout;
+        int changed = all;
+
+        if (all) {
+            sweeplines(displaywin, 2, 16);
+            drawn.layout = layout;
         }
 
+        int operation = current_op ? current_op->character : ' ';
         if(!operation_enabled) prio += 2;
-        else mvwprintw_colors(displaywin, 2, 2, COLOR_PAIR_OPERATION, "Operation: %c\n", current_op ? current_op->character : ' ');
+        else if (all || operation != drawn.operation) {
+            sweepline(displaywin, 2, 0);
+            char symbol[MAX_KEYWORD_LEN + 1] = " ";
+            if (current_op)
+                format_operation(symbol, current_op);
+            mvwprintw_colors(displaywin, 2, 2, COLOR_PAIR_OPERATION, "Operation: %s\n", symbol);
+            drawn.operation = operation;
+            changed = 1;
+        }
+
+        // Numbers of more than 64 bits are compared in all of their limbs, and in how many bits they have
+        int wide_changed = drawn.wide != (w != NULL ? globalmasksize : 0)
+            || (w != NULL && memcmp(w->limbs, drawn.wide_value.limbs, wide_limbs() * sizeof(uint64_t)));
+        int value_changed = all || n != drawn.value || wide_changed;
+        drawn.value = n;
+        drawn.wide = w != NULL ? globalmasksize : 0;
+        if (w != NULL && wide_changed)
+            wide_copy(&drawn.wide_value, w);
 
         if(!decimal_enabled) prio += 2;
-        else mvwprintw_colors(displaywin, 4-prio, 2, COLOR_PAIR_DECIMAL, "Decimal:   %lld", (long long)n);
+        else if (value_changed) {
+            char decimal[WIDE_FORMAT_BUFFER_SIZE];
+            if (w != NULL)
+                elide_digits(decimal, format_wide_signed_decimal(decimal, w), wMaxX - 15);
+            else
+                format_signed_decimal(decimal, n);
+            sweepline(displaywin, 4-prio, 0);
+            mvwprintw_colors(displaywin, 4-prio, 2, COLOR_PAIR_DECIMAL, "Decimal:   %s", decimal);
+            changed = 1;
+        }
 
         if(!hex_enabled && !ascii_enabled) prio += 2;
-		else display_ascii_hex(n, 6-prio);
+        else if (value_changed) {
+            sweepline(displaywin, 6-prio, 0);
+            display_ascii_hex(n, w, 6-prio);
+            changed = 1;
+        }
 
         if(!binary_enabled) prio +=6;
-        else printbinary(n,prio);
+        else if (all || n != drawn.binary || globalmasksize != drawn.masksize || wide_changed) {
+            sweeplines(displaywin, 8-prio, 13-prio);
+            char pane[WIDE_FORMAT_BUFFER_SIZE];
+            if (w != NULL) {
+                format_wide_binary_pane(pane, w, wide_bits_per_line(), 4);
+                printbinary(pane, 4, prio);
+            }
+            else {
+                format_binary_pane(pane, n, globalmasksize);
+                printbinary(pane, 2, prio);
+            }
+            drawn.binary = n;
+            drawn.masksize = globalmasksize;
+            changed = 1;
+        }
 
         if(!history_enabled) prio += 2;
-        else printhistory(numbers,prio);
+        else if (all || history_version != drawn.history_version) {
+            sweepline(displaywin, 14-prio, 0);
+            printhistory(numbers,prio);
+            // Drawing it can start the history over
+            drawn.history_version = history_version;
+            changed = 1;
+        }
 
-        wrefresh(displaywin);
+        // The statistics change all the time, and the symbols are drawn again when they're hidden
+        if (stats_pane_enabled) {
+            printstats();
+            changed = 1;
+        }
+        else if (drawn.stats) {
+            sweeplines(displaywin, wMaxY-4-symbol_lines(), wMaxY-4);
+            if (symbols_enabled)
+                printsymbols();
+            changed = 1;
+        }
+        drawn.stats = stats_pane_enabled;
+
+        // Both windows are sent to the terminal at once with the input (see get_input()), the display window only if it changed
+        if (changed)
+            wnoutrefresh(displaywin);
 
-        // Clear input
+        // Clear input and its preview
         sweepline(inputwin, 1, 19);
+        printpreview(NULL, 0);
 
         // Prompt input
         mvwprintw_colors(inputwin, 1, 2, COLOR_PAIR_INPUT, "Number or operator: ");
-        wrefresh(inputwin);
+        wnoutrefresh(inputwin);
 
     }
     else {
 
-        printf("Decimal: %lld, Hex: 0x%llx, Operation: %c\n", (long long)n, (unsigned long long)n, current_op ? current_op->character : ' ');
-        /* printf("created|freed -> tokens: %d|%d, parsers: %d|%d, trees: %d|%d\n", total_tokens_created, total_tokens_freed, total_parsers_created, total_parsers_freed, total_trees_created, total_trees_freed); */
+        // Batch mode - results are collected in the output buffer and written in bulk
+        char line[2 * WIDE_FORMAT_BUFFER_SIZE];
+        int len = 0;
+
+        memcpy(line, "Decimal: ", 9);
+        if (w != NULL)
+            len = 9 + format_wide_signed_decimal(line + 9, w);
+        else
+            len = 9 + format_signed_decimal(line + 9, n);
+        memcpy(line + len, ", Hex: 0x", 9);
+        len += 9;
+        if (w != NULL)
+            len += format_wide_hex(line + len, w, 0);
+        else
+            len += format_hex(line + len, n, 0);
+        memcpy(line + len, ", Operation: ", 13);
+        len += 13;
+        if (current_op)
+            len += format_operation(line + len, current_op);
+        else
+            line[len++] = ' ';
+        line[len++] = '\n';
+
+        batch_write(line, len);
     }
 }
 
+/**
+ * @brief Show the value the prompt would give over the bottom border of the input window, if it has one
+ */
+void printpreview(const char* prompt, size_t len) {
+
+    uint64_t value;
+
+    mvwhline(inputwin, 2, 1, 0, wMaxX-2);
+
+    if (!preview_prompt(prompt, len, &value))
+        return;
+
+    char decimal[FORMAT_BUFFER_SIZE], hex[FORMAT_BUFFER_SIZE];
+    format_signed_decimal(decimal, value);
+    format_hex(hex, value, 0);
+
+    mvwprintw_colors(inputwin, 2, 2, COLOR_PAIR_INPUT, " = %.*s ", wMaxX-7, decimal);
+    if (getcurx(inputwin) + (int) strlen(hex) + 6 < wMaxX)
+        wprintw_colors(inputwin, COLOR_PAIR_INPUT, "(0x%s) ", hex);
+}
+
+/**
+ * @brief Show the query of the history search over the top border of the input window, or only the border when *query* is NULL
+ */
+void printsearch(const char* query, int len, int found) {
+
+    mvwhline(inputwin, 0, 1, 0, wMaxX-2);
+
+    if (query == NULL)
+        return;
+
+    // The end of the query is shown when it doesn't fit
+    int width = wMaxX - 16 > 0 ? wMaxX - 16 : 0;
+    if (len > width) {
+        query += len - width;
+        len = width;
+    }
+
+    mvwprintw_colors(inputwin, 0, 2, COLOR_PAIR_INPUT, " %s: %.*s ", found ? "search" : "no match", len, query);
+}
+
 void mvwprintw_colors(WINDOW* w, int y, int x, enum colors color_pair, const char* format, ...) {
     /* Prints colors if available otherwise not */
     va_list ap;
@@ -246,3 +501,32 @@ void sweepline(WINDOW* w, int y, int x) {
     wmove(w, y, x);
     wclrtoeol(w);
 }
+
+/**
+ * @brief Clear the lines from *first* up to (not including) *last*
+ */
+static void sweeplines(WINDOW* w, int first, int last) {
+    for (int y = first; y < last; y++)
+        sweepline(w, y, 0);
+}
+
+/**
+ * @brief Bits in each line of the binary pane of a number of more than 64 bits, as many as fit in the window
+ */
+static int wide_bits_per_line() {
+
+    // Each line has the indentation, the label, and the bits in groups of 8
+    int bits = 64;
+    while (bits > 16 && 15 + bits + bits / 8 - 1 > wMaxX - 4)
+        bits /= 2;
+
+    return bits;
+}
+
+/**
+ * @brief The panes that are enabled, one bit each
+ */
+static int pane_layout() {
+    return operation_enabled | decimal_enabled << 1 | hex_enabled << 2 | ascii_enabled << 3
+        | binary_enabled << 4 | history_enabled << 5;
+}
@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "format.h"
+#include "history.h"
+#include "operators.h"
+
+/*
+ * Number formatting
+ *
+ * All functions write into a buffer given by the caller (at least FORMAT_BUFFER_SIZE bytes),
+ * NUL terminate it and return the number of characters written.
+ * Digits are produced from lookup tables: two decimal digits, one hex digit or eight binary digits at a time
+ */
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+static const char hex_digits_upper[] = "0123456789ABCDEF";
+
+// The eight binary digits of every byte, most significant first
+#define BITS8(b) { '0' + (((b) >> 7) & 1), '0' + (((b) >> 6) & 1), '0' + (((b) >> 5) & 1), '0' + (((b) >> 4) & 1), \
+                   '0' + (((b) >> 3) & 1), '0' + (((b) >> 2) & 1), '0' + (((b) >> 1) & 1), '0' + ((b) & 1) }
+#define BITS8_4(b) BITS8(b), BITS8((b) + 1), BITS8((b) + 2), BITS8((b) + 3)
+#define BITS8_16(b) BITS8_4(b), BITS8_4((b) + 4), BITS8_4((b) + 8), BITS8_4((b) + 12)
+#define BITS8_64(b) BITS8_16(b), BITS8_16((b) + 16), BITS8_16((b) + 32), BITS8_16((b) + 48)
+
+static const char byte_bits[256][8] = { BITS8_64(0), BITS8_64(64), BITS8_64(128), BITS8_64(192) };
+
+// ASCII control characters
+static const char* ctrl_chars[] = { "NUL", "SOH", "STX", "ETX", "EOT", "ENQ", "ACK",
+    "BEL", "BS", "HT", "LF", "VT", "FF", "CR", "SO", "SI", "DLE", "DC1", "DC2",
+    "DC3", "DC4", "NAK", "SYN", "ETB", "CAN", "EM", "SUB", "ESC", "FS", "GS",
+    "RS", "US", "SPACE"};
+
+static int append_bits(char*, uint64_t, int, int);
+
+
+/**
+ * @brief Unsigned decimal
+ */
+int format_decimal(char* buf, uint64_t value) {
+
+    // Digits are written from the end of a temporary buffer, two at a time
+    char digits[20];
+    int pos = sizeof(digits);
+
+    while (value >= 100) {
+        unsigned pair = value % 100;
+        value /= 100;
+        pos -= 2;
+        memcpy(digits + pos, digit_pairs + 2 * pair, 2);
+    }
+
+    if (value >= 10) {
+        pos -= 2;
+        memcpy(digits + pos, digit_pairs + 2 * value, 2);
+    }
+    else
+        digits[--pos] = '0' + value;
+
+    int len = sizeof(digits) - pos;
+    memcpy(buf, digits + pos, len);
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Decimal of the value as a signed 64 bit integer
+ */
+int format_signed_decimal(char* buf, uint64_t value) {
+
+    if ((int64_t) value >= 0)
+        return format_decimal(buf, value);
+
+    buf[0] = '-';
+    return format_decimal(buf + 1, -value) + 1;
+}
+
+/**
+ * @brief Hexadecimal without a prefix or leading zeros
+ */
+int format_hex(char* buf, uint64_t value, int uppercase) {
+
+    const char* table = uppercase ? hex_digits_upper : hex_digits;
+
+    int ndigits = 1;
+    while (ndigits < 16 && value >> (4 * ndigits))
+        ndigits++;
+
+    for (int i = 0; i < ndigits; i++)
+        buf[i] = table[(value >> (4 * (ndigits - 1 - i))) & 0xf];
+
+    buf[ndigits] = '\0';
+    return ndigits;
+}
+
+/**
+ * @brief The lowest *nbits* binary digits of the value, most significant first
+ */
+int format_binary(char* buf, uint64_t value, int nbits) {
+
+    int len = append_bits(buf, value, nbits, 0);
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief The binary digits as shown in the binary pane
+ *
+ * Digits are separated by spaces, with bigger gaps between groups of 4 and 8,
+ * and a new line (labeled with the number of bits left) every 16 bits
+ */
+int format_binary_pane(char* buf, uint64_t value, int nbits) {
+
+    int len = 0;
+
+    // The first line is labeled with the number of bits
+    buf[len++] = '0' + nbits / 10;
+    buf[len++] = '0' + nbits % 10;
+    buf[len++] = ' ';
+    buf[len++] = ' ';
+
+    // Positions count from the most significant of the 64 bits, as i in the loop below
+    for (int i = DEFAULT_MASK_SIZE - nbits; i < DEFAULT_MASK_SIZE; ) {
+
+        int bit = DEFAULT_MASK_SIZE - 1 - i;
+        const char* digits;
+        int ndigits;
+
+        if (i % 8 == 0) {
+            // Whole byte from the table
+            digits = byte_bits[(value >> (bit - 7)) & 0xff];
+            ndigits = 8;
+        }
+        else {
+            // Leading bits before the first whole byte
+            digits = &byte_bits[(value >> bit) & 1][7];
+            ndigits = 1;
+        }
+
+        for (int j = 0; j < ndigits; j++, i++) {
+
+            buf[len++] = digits[j];
+
+            if (i % 16 == 15 && DEFAULT_MASK_SIZE - (i / 16 + 1) * 16) {
+                int label = DEFAULT_MASK_SIZE - (i / 16 + 1) * 16;
+                memcpy(buf + len, "\n         ", 10);
+                len += 10;
+                buf[len++] = '0' + label / 10;
+                buf[len++] = '0' + label % 10;
+                buf[len++] = ' ';
+                buf[len++] = ' ';
+            }
+            else if (i % 8 == 7) {
+                memcpy(buf + len, "   ", 3);
+                len += 3;
+            }
+            else if (i % 4 == 3) {
+                memcpy(buf + len, "  ", 2);
+                len += 2;
+            }
+            else
+                buf[len++] = ' ';
+        }
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Name of the ASCII character of the value, which must be at most 127
+ */
+int format_ascii(char* buf, uint64_t value) {
+
+    int len;
+
+    if (value < sizeof(ctrl_chars) / sizeof(ctrl_chars[0])) {
+        len = strlen(ctrl_chars[value]);
+        memcpy(buf, ctrl_chars[value], len);
+    }
+    else if (value == 127) {
+        len = 3;
+        memcpy(buf, "DEL", 3);
+    }
+    else {
+        len = 1;
+        buf[0] = (char) value;
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Number as written in the history: unsigned decimal, 0x hex, or 0b binary without leading zeros
+ */
+int format_number(char* buf, uint64_t value, int type) {
+
+    if (type == NTYPE_HEX) {
+        memcpy(buf, "0x", 2);
+        return format_hex(buf + 2, value, 1) + 2;
+    }
+
+    if (type == NTYPE_BIN) {
+
+        int nbits = 0;
+        while (nbits < globalmasksize && value >> nbits)
+            nbits++;
+
+        memcpy(buf, "0b", 2);
+        return format_binary(buf + 2, value, nbits ? nbits : 1) + 2;
+    }
+
+    return format_decimal(buf, value);
+}
+
+/**
+ * @brief Write the lowest *nbits* binary digits at *buf*, whole bytes at a time
+ */
+static int append_bits(char* buf, uint64_t value, int nbits, int len) {
+
+    // Leading bits until the rest is a whole number of bytes
+    for (; nbits % 8; nbits--)
+        buf[len++] = '0' + ((value >> (nbits - 1)) & 1);
+
+    for (; nbits > 0; nbits -= 8, len += 8)
+        memcpy(buf + len, byte_bits[(value >> (nbits - 8)) & 0xff], 8);
+
+    return len;
+}
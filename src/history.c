@@ -3,41 +3,120 @@
 #include <string.h>
 
 #include "draw.h"
+#include "format.h"
 #include "global.h"
 #include "history.h"
+#include "stats.h"
+#include "wide.h"
 #include "xmalloc.h"
 
-struct history searchHistory;
-struct history history;
+_Thread_local struct history searchHistory;
+_Thread_local struct history history;
+_Thread_local unsigned long history_version = 0;
+
+static int make_room(struct history*, int);
+
+
+/**
+ * @brief Start an empty history that keeps at most *memory* bytes of records
+ *
+ * With *dedup*, a record the same as the one before it isn't added
+ */
+void init_history(struct history* h, int memory, int dedup) {
+
+    h->size = 0;
+    h->text = NULL;
+    h->memory = memory;
+    h->offsets = NULL;
+    // Records take at least 2 bytes, there's never more than this many
+    h->max_records = memory / 2;
+    h->first = 0;
+    h->tail = 0;
+    h->dedup = dedup;
+    h->last_len = -1;
+}
 
 void clear_history() {
 
-    for (; history.size>0; history.size--)
-        free(history.records[history.size-1]);
-
-    free(history.records);
-    // To make sure realloc behaves like malloc later
-    history.records = NULL;
+    // The memory is kept for the next records
+    history.size = 0;
+    history.first = 0;
+    history.tail = 0;
+    history_version++;
 
     sweepline(displaywin, 14, 11);
     sweepline(displaywin, 15, 0);
 }
 
-void add_to_history(struct history* h, char* in) {
+/**
+ * @brief Add a record, returns 0 when it's the same as the last one of a history that drops duplicates
+ */
+int add_to_history(struct history* h, const char* in) {
+
+    if (*in == '\0' && h == &history)
+        in = "0";
+
+    // Length and hash (FNV-1a) in one pass, so a record is only compared when it can be the same
+    uint64_t hash = 0xcbf29ce484222325;
+    int len = 0;
+    for (; in[len] != '\0'; len++)
+        hash = (hash ^ (unsigned char) in[len]) * 0x100000001b3;
+
+    if (h->dedup && h->size > 0 && hash == h->last_hash && len == h->last_len
+            && !memcmp(in, history_get(h, h->size - 1), len))
+        return 0;
+
+    if (h->text == NULL) {
+        h->text = xmalloc(h->memory);
+        h->offsets = xmalloc(h->max_records * sizeof(int));
+    }
+
+    // A record longer than the whole history is cut
+    int n = len < h->memory ? len + 1 : h->memory;
+    int start = make_room(h, n);
 
-    if (h->size % HISTORY_RECORDS_BEFORE_REALLOC == 0)
-        h->records = xrealloc(h->records, (h->size + HISTORY_RECORDS_BEFORE_REALLOC) * sizeof(char *));
+    memcpy(h->text + start, in, n - 1);
+    h->text[start + n - 1] = '\0';
 
-    if ((h->records[h->size++] = strdup(*in == '\0' && h == &history ? "0" : in)) == NULL)
-        exit_pcalc(MEM_FAIL);
+    h->offsets[(h->first + h->size) % h->max_records] = start;
+    h->size++;
+    h->tail = start + n;
 
+    h->last_hash = hash;
+    h->last_len = n == len + 1 ? len : -1;
+
+    if (h == &history) {
+        history_version++;
+        if (h->size > stats.peak_history_size)
+            stats.peak_history_size = h->size;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief The i-th record, from the oldest one
+ */
+const char* history_get(const struct history* h, int i) {
+
+    return h->text + h->offsets[(h->first + i) % h->max_records];
 }
 
 void add_number_to_history(uint64_t n, int type) {
 
-    char *str = str_with_base_of_number(n, type);
+    char str[FORMAT_BUFFER_SIZE];
+    format_number(str, n, type);
+    add_to_history(&history, str);
+}
+
+/**
+ * @brief Add a number of more than 64 bits in decimal, with the middle digits left out when there are too many
+ */
+void add_wide_number_to_history(const wide* n) {
+
+    char str[WIDE_FORMAT_BUFFER_SIZE];
+    elide_digits(str, format_wide_decimal(str, n), WIDE_HISTORY_DIGITS);
     add_to_history(&history, str);
-    xfree(str);
 }
 
 void browsehistory(char* in , int mode, int* counter) {
@@ -51,7 +130,7 @@ void browsehistory(char* in , int mode, int* counter) {
     if( (mode == 1 && *counter < searchHistory.size-1) || (mode == -1 && *counter > 0)) {
 
         *counter += mode;
-        strcpy(in, searchHistory.records[*counter]);
+        strcpy(in, history_get(&searchHistory, *counter));
     }
     else if (mode == 1 && *counter == searchHistory.size - 1) {
 
@@ -73,43 +152,46 @@ void browsehistory(char* in , int mode, int* counter) {
 
 void free_history(struct history *h) {
 
-    for (int i = 0; i < h->size; ++i)
-        xfree(h->records[i]);
-
-    xfree(h->records);
+    xfree(h->text);
+    xfree(h->offsets);
 
+    h->text = NULL;
+    h->offsets = NULL;
+    h->size = 0;
 }
 
-
-char *str_with_base_of_number(uint64_t n, int type) {
-
-    char *str = xmalloc(67);
-
-    if (type == 0)
-        sprintf(str,"%llu", (unsigned long long)n);
-    else if (type == 1)
-        sprintf(str,"0x%llX", (unsigned long long)n);
-    else if (type == 2) {
-
-        uint64_t mask = ror(1, 1);
-
-        int i = 0;
-        for (; i<64; i++, mask>>=1)
-            if (mask & n)
-                break;
-
-        int nbits = globalmasksize - i;
-
-        sprintf(str, "0b");
-        if (nbits == 0)
-            str[2] = '0';
-        else
-            for (i=0; i<nbits; i++, mask>>=1)
-                str[i+2] = mask & n ? '1' : '0';
-
-        str[i+2] = '\0';
+/**
+ * @brief Drop the oldest records until *n* bytes fit after the newest one, returns where they go
+ *
+ * A record never wraps around the end of the ring, it starts over from the beginning instead
+ */
+static int make_room(struct history* h, int n) {
+
+    for (;;) {
+
+        if (h->size == 0) {
+            h->first = 0;
+            return 0;
+        }
+
+        int head = h->offsets[h->first];
+
+        if (h->size < h->max_records) {
+
+            if (h->tail > head) {
+                // The records are in one piece, there's room after them or before them
+                if (h->tail + n <= h->memory)
+                    return h->tail;
+                if (n <= head)
+                    return 0;
+            }
+            else if (h->tail + n <= head) {
+                // The records wrap around, the room is between the newest and the oldest one
+                return h->tail;
+            }
+        }
+
+        h->first = (h->first + 1) % h->max_records;
+        h->size--;
     }
-
-    return str;
-
 }
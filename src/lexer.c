@@ -0,0 +1,306 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "literals.h"
+#include "operators.h"
+#include "parser.h"
+#include "wide.h"
+
+/*
+ * The lexer turns sanitized input into tokens in a single pass
+ *
+ * Every character is classified with one lookup in the char_class table,
+ * and numbers are decoded while their digits are read, so the parser never looks at characters
+ */
+
+unsigned char char_class[256];
+unsigned char digit_value[256];
+
+int variables_enabled = 0;
+
+static int lex_number(const char*, int, int, token*);
+
+
+/**
+ * @brief Build the character tables, must be called after init_operations()
+ */
+void init_lexer() {
+
+    for (const char* c = VALID_DEC_SYMBOLS; *c; c++)
+        char_class[(unsigned char) *c] |= CHAR_DEC;
+    for (const char* c = VALID_HEX_SYMBOLS; *c; c++)
+        char_class[(unsigned char) *c] |= CHAR_HEX;
+    for (const char* c = VALID_BIN_SYMBOLS; *c; c++)
+        char_class[(unsigned char) *c] |= CHAR_BIN;
+    for (const char* c = VALID_OPERAND_TOKENS; *c; c++)
+        char_class[(unsigned char) *c] |= CHAR_TOKEN;
+
+    for (int i = 0; get_operation(i) != NULL; i++) {
+
+        const operation* op = get_operation(i);
+        if (op->keyword != NULL) {
+            char_class[(unsigned char) op->keyword[0]] |= CHAR_KEYWORD;
+            char_class[(unsigned char) op->character] |= CHAR_NAMED;
+        }
+    }
+
+    for (int c = 0; c < 256; c++) {
+
+        // The character of an operation with a keyword only comes from the keyword, it's dropped when typed
+        if (getopcode(c) && getopcode(c)->keyword == NULL)
+            char_class[c] |= CHAR_TOKEN;
+
+        if (c >= '0' && c <= '9')
+            digit_value[c] = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit_value[c] = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit_value[c] = c - 'A' + 10;
+    }
+}
+
+/**
+ * @brief Copy the characters sanitize() keeps of the *len* at *input* to *output*, returns how many were kept
+ *
+ * A keyword is kept as the character of its operation. Every keyword has a letter that is dropped
+ * in its first two, so they're only looked for at the dropped characters (see keyword_at())
+ */
+size_t sanitize_into(char* output, const char* input, size_t len) {
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+
+        unsigned char c = input[i];
+
+        if (char_class[c] & CHAR_TOKEN) {
+            output[n++] = c;
+            continue;
+        }
+
+        operation* op = keyword_at(input, len, &i);
+        if (op != NULL) {
+            // The first letter was kept when it's a hex digit, and it's part of the keyword instead
+            if (char_class[(unsigned char) op->keyword[0]] & CHAR_TOKEN)
+                n--;
+            output[n++] = op->character;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief Find the keyword with the dropped character at *pos* as its first or second letter
+ *
+ * Returns its operation with *pos* moved to its last letter, or NULL if there's no keyword there.
+ * A keyword that starts at *pos* - 1 starts with a letter that was kept (i.e. the c of clz)
+ */
+operation* keyword_at(const char* input, size_t len, size_t* pos) {
+
+    size_t start = *pos > 0 ? *pos - 1 : *pos;
+
+    for (; start <= *pos; start++) {
+
+        unsigned char c = input[start];
+        if (!(char_class[c] & CHAR_KEYWORD) || (start < *pos && !(char_class[c] & CHAR_TOKEN)))
+            continue;
+
+        operation* op = keyword_operation(input + start, len - start);
+        if (op != NULL) {
+            *pos = start + strlen(op->keyword) - 1;
+            return op;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Split the sanitized input into tokens
+ *
+ * *tokens* must have room for len + 1 tokens. Lexing stops at the first character that can't start a
+ * token (i.e. a hex letter without the 0x prefix), because the parser would stop there too.
+ * The tokens always end with a TOK_END token, which isn't counted in the returned number of tokens
+ */
+int lex(const char* input, int len, token* tokens) {
+
+    int ntokens = 0;
+    int pos = 0;
+
+    while (pos < len) {
+
+        int end = lex_token(input, len, pos, &tokens[ntokens]);
+        if (end == pos)
+            break;
+
+        pos = end;
+        ntokens++;
+    }
+
+    tokens[ntokens].type = TOK_END;
+
+    return ntokens;
+}
+
+/**
+ * @brief Read the token at *pos* into *t*, returns the position after it (or *pos* if no token starts there)
+ *
+ * A token only depends on its characters and the one right after it, so the tokens that end
+ * before the first changed character of an input are still valid after the change
+ */
+int lex_token(const char* input, int len, int pos, token* t) {
+
+    unsigned char c = input[pos];
+
+    if (c == LPAR_SYMBOL)
+        t->type = TOK_LPAR;
+    else if (c == RPAR_SYMBOL)
+        t->type = TOK_RPAR;
+    else if ((t->op = getopcode(c)) != NULL)
+        t->type = TOK_OPERATOR;
+    else if (c == VARIABLE_SYMBOL && variables_enabled
+            && !(pos+1 < len && (char_class[(unsigned char) input[pos+1]] & CHAR_HEX)))
+        t->type = TOK_VARIABLE;
+    else
+        return lex_number(input, len, pos, t);
+
+    return pos + 1;
+}
+
+/**
+ * @brief Read a single number literal from the start of *input*
+ *
+ * Returns the number of characters it takes, or 0 if *input* doesn't start with a number
+ */
+int lex_literal(const char* input, int len, uint64_t* value) {
+
+    token t;
+
+    int end = lex_number(input, len, 0, &t);
+    if (end > 0)
+        *value = t.value;
+
+    return end;
+}
+
+/**
+ * @brief Read the number at *pos* into *t*, returns the position after it (or *pos* if there's no number)
+ */
+static int lex_number(const char* input, int len, int pos, token* t) {
+
+    // Grammar rule: number: ( (0-9)+ | 0?x(0-9a-f)+ | 0?b(0-1)+ )
+
+    int numbertype = DEC_TYPE;
+    int start = pos;
+
+    if (pos+1 < len) {
+        switch (input[pos]) {
+            case '0':
+                // check second character
+                switch (input[pos+1]) {
+                    case 'b': // 0b0101
+                        numbertype = BIN_TYPE;
+                        pos += 2;
+                        break;
+                    case 'x': // 0xffff
+                        numbertype = HEX_TYPE;
+                        pos += 2;
+                        break;
+                    default:  // number is decimal
+                        break;
+                }
+                break;
+            case 'x': // xffff
+                numbertype = HEX_TYPE;
+                pos += 1;
+                break;
+            case 'b': // b0101
+                numbertype = BIN_TYPE;
+                pos += 1;
+                break;
+        }
+    }
+
+    unsigned char digit_class;
+    uint64_t base;
+    switch (numbertype) {
+        case HEX_TYPE: digit_class = CHAR_HEX; base = 16; break;
+        case BIN_TYPE: digit_class = CHAR_BIN; base = 2; break;
+        default:       digit_class = CHAR_DEC; base = 10; break;
+    }
+
+    uint64_t value = 0;
+    int overflow = 0;
+    int digits_start = pos;
+
+    // Fast paths for long literals: whole blocks of digits are validated and converted at once,
+    // and whatever is left is handled one digit at a time below
+    uint64_t block;
+    if (numbertype == HEX_TYPE) {
+
+        if (len - pos >= 16 && decode_hex16(input + pos, &block)) {
+            value = block;
+            pos += 16;
+        }
+        else if (len - pos >= 8 && decode_hex8(input + pos, &block)) {
+            value = block;
+            pos += 8;
+        }
+    }
+    else if (numbertype == BIN_TYPE) {
+
+        if (len - pos >= 64 && decode_bin64(input + pos, &block)) {
+            value = block;
+            pos += 64;
+        }
+        else {
+            // Blocks of 8 digits can't overflow while the top byte is still free
+            while (len - pos >= 8 && value >> 56 == 0 && decode_bin8(input + pos, &block)) {
+                value = value << 8 | block;
+                pos += 8;
+            }
+        }
+    }
+
+    // Accumulate the digits, saturating on overflow like strtoull does
+
+    for (; pos < len && (char_class[(unsigned char) input[pos]] & digit_class); pos++) {
+
+        uint64_t digit = digit_value[(unsigned char) input[pos]];
+
+        if (value > (UINT64_MAX - digit) / base)
+            overflow = 1;
+
+        value = value * base + digit;
+    }
+
+    if (pos == digits_start) {
+
+        // A prefix without digits is a zero, but without a prefix there's no number at all
+        if (pos == start)
+            return start;
+
+        numbertype = DEC_TYPE;
+    }
+
+    if (globalmasksize > DEFAULT_MASK_SIZE) {
+
+        // The digits are decoded again into as many limbs as the number of bits takes
+        wide* w = arena_alloc(&eval_arena, sizeof(wide));
+        wide_literal(input + digits_start, pos - digits_start, base, w);
+
+        t->type = TOK_WIDE_NUMBER;
+        t->numbertype = numbertype;
+        t->wide_value = w;
+
+        return pos;
+    }
+
+    t->type = TOK_NUMBER;
+    t->numbertype = numbertype;
+    t->value = overflow ? UINT64_MAX : value;
+
+    return pos;
+}
@@ -0,0 +1,198 @@
+#include <stdint.h>
+
+#include "literals.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * The portable versions work on 8 characters at a time packed in a uint64_t (SWAR),
+ * SSE2 and AVX2 versions are used instead when the compiler targets them (i.e. -march=native)
+ */
+
+#define ONES 0x0101010101010101ull
+#define HIGH_BITS 0x8080808080808080ull
+
+static uint64_t load_le64(const char*);
+static uint64_t bytes_between(uint64_t, unsigned char, unsigned char);
+
+
+/**
+ * @brief Decode 8 hex digits (upper or lower case) into a 32 bit value
+ */
+int decode_hex8(const char* digits, uint64_t* value) {
+
+    uint64_t x = load_le64(digits);
+
+    // Every byte must be ASCII, and either a decimal digit or a letter from a to f in any case
+    uint64_t decimal = bytes_between(x, '0', '9');
+    uint64_t letters = bytes_between(x | (0x20 * ONES), 'a', 'f');
+
+    if ((x & HIGH_BITS) || (decimal | letters) != HIGH_BITS)
+        return 0;
+
+    // The low nibble is the digit value for 0-9, and the value minus 9 for a-f
+    uint64_t nibbles = (x & (0x0f * ONES)) + (letters >> 7) * 9;
+
+    // The first character is in the lowest byte and is the most significant digit:
+    // merge the nibbles in pairs, the bytes in pairs, and finally the 16 bit halves
+    uint64_t bytes = ((nibbles << 4) | (nibbles >> 8)) & 0x00ff00ff00ff00ffull;
+    uint64_t halves = ((bytes << 8) | (bytes >> 16)) & 0x0000ffff0000ffffull;
+
+    *value = ((halves << 16) | (halves >> 32)) & 0xffffffffull;
+    return 1;
+}
+
+/**
+ * @brief Decode 16 hex digits (upper or lower case) into a 64 bit value
+ */
+int decode_hex16(const char* digits, uint64_t* value) {
+
+#if defined(__SSE2__)
+
+    __m128i x = _mm_loadu_si128((const __m128i*) digits);
+
+    // Same classification as decode_hex8, with signed compares (non ASCII bytes are negative and never match)
+    __m128i decimal = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    letters = _mm_andnot_si128(_mm_cmplt_epi8(x, _mm_setzero_si128()), letters);
+
+    if (_mm_movemask_epi8(_mm_or_si128(decimal, letters)) != 0xffff)
+        return 0;
+
+    __m128i nibbles = _mm_add_epi8(_mm_and_si128(x, _mm_set1_epi8(0x0f)), _mm_and_si128(letters, _mm_set1_epi8(9)));
+
+    // Merge each pair of nibbles in a 16 bit lane into one byte, then pack the lanes into 8 bytes
+    __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(nibbles, 8));
+    __m128i packed = _mm_packus_epi16(bytes, bytes);
+
+    uint64_t le;
+    _mm_storel_epi64((__m128i*) &le, packed);
+
+    // The first byte holds the most significant digits
+    *value = __builtin_bswap64(le);
+    return 1;
+
+#else
+
+    uint64_t high, low;
+    if (!decode_hex8(digits, &high) || !decode_hex8(digits + 8, &low))
+        return 0;
+
+    *value = high << 32 | low;
+    return 1;
+
+#endif
+}
+
+/**
+ * @brief Decode 8 binary digits into an 8 bit value
+ */
+int decode_bin8(const char* digits, uint64_t* value) {
+
+    uint64_t x = load_le64(digits);
+
+    // Every byte must be '0' (0x30) or '1' (0x31)
+    if ((x & (0xfe * ONES)) != 0x30 * ONES)
+        return 0;
+
+    // Gather bit 0 of every byte into the top byte, the first character being the most significant bit
+    *value = ((x & ONES) * 0x8040201008040201ull) >> 56;
+    return 1;
+}
+
+/**
+ * @brief Decode 64 binary digits into a 64 bit value
+ */
+int decode_bin64(const char* digits, uint64_t* value) {
+
+#if defined(__AVX2__)
+
+    // Reverses the bytes inside each 128 bit lane, the lanes are swapped afterwards
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    uint64_t out = 0;
+
+    for (int i = 0; i < 2; i++) {
+
+        __m256i x = _mm256_loadu_si256((const __m256i*) (digits + 32 * i));
+
+        if ((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(x, _mm256_set1_epi8((char) 0xfe)), _mm256_set1_epi8(0x30))) != 0xffffffffu)
+            return 0;
+
+        // Move bit 0 of every byte to the top so movemask picks it, with the first character as the highest bit
+        x = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, reverse), 0x4e);
+        out = out << 32 | (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi64(x, 7));
+    }
+
+    *value = out;
+    return 1;
+
+#elif defined(__SSE2__)
+
+    uint64_t out = 0;
+
+    for (int i = 0; i < 4; i++) {
+
+        __m128i x = _mm_loadu_si128((const __m128i*) (digits + 16 * i));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8((char) 0xfe)), _mm_set1_epi8(0x30))) != 0xffff)
+            return 0;
+
+        // Reverse the 16 bytes (SSE2 has no byte shuffle): dwords, then words, then the bytes in each word
+        x = _mm_shuffle_epi32(x, 0x1b);
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+
+        // Move bit 0 of every byte to the top so movemask picks it, with the first character as the highest bit
+        out = out << 16 | (uint16_t) _mm_movemask_epi8(_mm_slli_epi64(x, 7));
+    }
+
+    *value = out;
+    return 1;
+
+#else
+
+    uint64_t out = 0;
+
+    for (int i = 0; i < 8; i++) {
+
+        uint64_t byte;
+        if (!decode_bin8(digits + 8 * i, &byte))
+            return 0;
+
+        out = out << 8 | byte;
+    }
+
+    *value = out;
+    return 1;
+
+#endif
+}
+
+/**
+ * @brief Load 8 characters with the first one in the lowest byte, on any endianness
+ */
+static uint64_t load_le64(const char* p) {
+
+    const unsigned char* u = (const unsigned char*) p;
+
+    return (uint64_t) u[0] | (uint64_t) u[1] << 8 | (uint64_t) u[2] << 16 | (uint64_t) u[3] << 24
+        | (uint64_t) u[4] << 32 | (uint64_t) u[5] << 40 | (uint64_t) u[6] << 48 | (uint64_t) u[7] << 56;
+}
+
+/**
+ * @brief Set the high bit of every byte of *x* between *lo* and *hi*, all bytes of *x* must be ASCII
+ */
+static uint64_t bytes_between(uint64_t x, unsigned char lo, unsigned char hi) {
+
+    uint64_t at_least_lo = x + (0x80 - lo) * ONES;
+    uint64_t above_hi = x + (0x7f - hi) * ONES;
+
+    return at_least_lo & ~above_hi & HIGH_BITS;
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+#include <errno.h>
 #include <getopt.h>
 #include <string.h>
 #include <stdlib.h>
@@ -8,11 +10,18 @@
 #include <signal.h>
 
 #include "global.h"
+#include "batch.h"
+#include "cache.h"
 #include "draw.h"
 #include "history.h"
+#include "lexer.h"
+#include "map.h"
 #include "numberstack.h"
 #include "operators.h"
 #include "parser.h"
+#include "search.h"
+#include "stats.h"
+#include "wide.h"
 
 
 
@@ -21,14 +30,44 @@
 #define VERSION "v3.0"
 
 
+// Expression evaluated for every input number in map mode, and the base of the results
+static char* map_expression = NULL;
+static int map_base = NTYPE_DEC;
+
+// Text or raw words (MAP_*) read and written in map mode, and their number of bits (0 for the default)
+static int map_input_format = MAP_TEXT;
+static int map_output_format = MAP_TEXT;
+static int map_bits = 0;
+
+// Number of threads evaluating the input in batch mode
+static int jobs = 1;
+
+// File read instead of stdin in batch and map mode
+static char* input_path = NULL;
+
+// Bytes kept of the input history
+static int history_memory = SEARCH_HISTORY_MEMORY;
+
+// File the inputs are kept in between sessions, $HOME/.pcalc_history by default
+static char* history_path = NULL;
+
+// Between the start and the end of a bracketed paste
+static int pasting = 0;
+
+
 
 
 
 /*---- Function Prototypes ----------------------------------------*/
 
 
-static void process_prompt(operation**, char*);
 static void get_input(char*);
+static int read_key(const char*, int);
+static void insert_key(char*, int*, int*, int);
+static int search_input(char*);
+static void draw_input(const char*, int);
+static int get_byte_order(const char*);
+static int is_command(const char*, size_t, const char*);
 static void apply_operations(numberstack*, operation**);
 static void exit_pcalc_success();
 
@@ -56,13 +95,23 @@ int main(int argc, char* argv[])
         {"colors",           no_argument, NULL, 'c'},
         {"alternate-colors", no_argument, NULL, 'a'},
         {"no-interface",     no_argument, NULL, 'n'},
+        {"stats",            no_argument, NULL, 'S'},
+        {"map",              required_argument, NULL, 'm'},
+        {"base",             required_argument, NULL, 'B'},
+        {"jobs",             required_argument, NULL, 'j'},
+        {"file",             required_argument, NULL, 'f'},
+        {"raw-in",           required_argument, NULL, 'r'},
+        {"raw-out",          required_argument, NULL, 'R'},
+        {"bits",             required_argument, NULL, 'w'},
+        {"history-memory",   required_argument, NULL, 'M'},
+        {"history-file",     required_argument, NULL, 'H'},
         {NULL,               0,           NULL,  0}
 
      };
 
     // Get command line options to hide parts of the display
     int opt;
-    while ((opt = getopt_long(argc, argv, "hvibxdoscan", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hvibxdoscanSm:B:j:f:r:R:w:M:H:", long_options, NULL)) != -1) {
         switch (opt) {
 
             case 'h':
@@ -80,6 +129,16 @@ int main(int argc, char* argv[])
                 puts("--colors = -c\t\t\tenables colors");
                 puts("--alternate-colors = -a \tenables alternate colors for 1s and 0s in binary");
                 puts("--no-interface = -n\t\tdisables graphical interface");
+                puts("--stats = -S\t\t\tprints memory, timing and cache statistics to stderr on exit");
+                puts("--map = -m EXPR\t\t\tprints EXPR for every number read from stdin, with x as the number");
+                puts("--base = -B dec|hex|bin\t\tbase of the numbers printed in map mode");
+                puts("--raw-in = -r le|be\t\treads the numbers of map mode as packed little or big endian words");
+                puts("--raw-out = -R le|be\t\twrites the results of map mode as packed little or big endian words");
+                puts("--bits = -w N\t\t\tnumber of bits of the numbers in map mode (8, 16, 32 or 64 for raw words)");
+                puts("--jobs = -j N\t\t\tevaluates the input of --no-interface with N threads (0 for all cores)");
+                puts("--file = -f PATH\t\treads the input from PATH instead of stdin (disables graphical interface)");
+                puts("--history-memory = -M KB\tkilobytes of input kept for the up and down arrows (64 by default)");
+                puts("--history-file = -H PATH\tfile the inputs are kept in and searched with Ctrl-R (~/.pcalc_history by default)");
                 exit(0);
                 break;
 
@@ -120,6 +179,69 @@ int main(int argc, char* argv[])
                 use_interface = 0;
                 break;
 
+            case 'S':
+                stats_enabled = 1;
+                stats_timers_enabled = 1;
+                break;
+
+            case 'm':
+                map_expression = optarg;
+                use_interface = 0;
+                break;
+
+            case 'j':
+                jobs = atoi(optarg);
+                if (jobs <= 0)
+                    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+                break;
+
+            case 'f':
+                input_path = optarg;
+                use_interface = 0;
+                break;
+
+            case 'r':
+                map_input_format = get_byte_order(optarg);
+                break;
+
+            case 'R':
+                map_output_format = get_byte_order(optarg);
+                break;
+
+            case 'w':
+                map_bits = atoi(optarg);
+                if (map_bits <= 0 || map_bits > DEFAULT_MASK_SIZE) {
+                    fprintf(stderr, "pcalc: invalid number of bits '%s'\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'M':
+                history_memory = atoi(optarg);
+                if (history_memory <= 0 || history_memory > INT_MAX / 1024) {
+                    fprintf(stderr, "pcalc: invalid history memory '%s'\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                history_memory *= 1024;
+                break;
+
+            case 'H':
+                history_path = optarg;
+                break;
+
+            case 'B':
+                if (!strcmp(optarg, "dec"))
+                    map_base = NTYPE_DEC;
+                else if (!strcmp(optarg, "hex"))
+                    map_base = NTYPE_HEX;
+                else if (!strcmp(optarg, "bin"))
+                    map_base = NTYPE_BIN;
+                else {
+                    fprintf(stderr, "pcalc: unknown base '%s' (use dec, hex or bin)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'c':
                 colors_enabled = 1;
                 break;
@@ -135,6 +257,52 @@ int main(int argc, char* argv[])
     }
 
 
+    init_operations();
+    init_lexer();
+
+    if ((map_input_format != MAP_TEXT || map_output_format != MAP_TEXT) && map_expression == NULL) {
+        fprintf(stderr, "pcalc: raw words can only be read or written in map mode (--map EXPR)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Map mode doesn't use the interface nor the stack (never returns)
+    if (map_expression != NULL) {
+
+        if (map_bits != 0)
+            set_globalmasksize(map_bits);
+
+        if ((map_input_format != MAP_TEXT || map_output_format != MAP_TEXT)
+                && globalmasksize != 8 && globalmasksize != 16 && globalmasksize != 32 && globalmasksize != 64) {
+            fprintf(stderr, "pcalc: raw words must have 8, 16, 32 or 64 bits\n");
+            exit(EXIT_FAILURE);
+        }
+
+        FILE* in = stdin;
+        if (input_path != NULL && (in = fopen(input_path, "r")) == NULL) {
+            fprintf(stderr, "pcalc: %s: %s\n", input_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        run_map(map_expression, in, map_base, map_input_format, map_output_format);
+    }
+
+    // The file is mapped before anything is printed, so nothing is if it can't be read
+    char* input_file = NULL;
+    size_t input_file_size = 0;
+    if (input_path != NULL)
+        input_file = map_batch_file(input_path, &input_file_size);
+
+    // The input history drops its consecutive duplicates, and its file is only used by the interface
+    init_history(&searchHistory, history_memory, 1);
+
+    char home_history_path[PATH_MAX];
+    if (history_path == NULL && getenv("HOME") != NULL
+            && snprintf(home_history_path, PATH_MAX, "%s/%s", getenv("HOME"), HISTORY_FILE_NAME) < PATH_MAX)
+        history_path = home_history_path;
+
+    if (use_interface && history_path != NULL)
+        open_history_file(history_path);
+
     init_gui(&displaywin, &inputwin);
 
     // Set handler for CTRL+C to clean exit
@@ -159,9 +327,8 @@ int main(int argc, char* argv[])
     numbers = create_numberstack(4);
     //operation* current_op = NULL;
 
-    // Initalize history pointers with NULL (realloc will bahave like malloc)
-    history.records = NULL;
-    searchHistory.records = NULL;
+    // The history pane shows every input and result, repeated ones too
+    init_history(&history, HISTORY_LINE_MEMORY, 0);
 
     // Start numberstack and history with 0
     push_numberstack(numbers, 0);
@@ -172,6 +339,16 @@ int main(int argc, char* argv[])
     // No longer add empty string to history bottom, because the scroll was reversed
     /* add_to_history(&searchHistory, ""); */
 
+    // Without the interface, evaluate the whole input in batch mode (never returns)
+    if (!use_interface) {
+        if (input_path != NULL)
+            run_batch_file(input_file, input_file_size, jobs);
+        else if (jobs > 1)
+            run_batch_jobs(stdin, jobs);
+        else
+            run_batch(stdin);
+    }
+
     //Main Loop
     for (;;) {
 
@@ -183,7 +360,7 @@ int main(int argc, char* argv[])
 
         get_input(in);
 
-        process_prompt(&current_op, in);
+        process_prompt(&current_op, in, strlen(in));
 
         // Display number on top of the stack
         draw(numbers, current_op);
@@ -194,49 +371,54 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-static void process_prompt(operation** current_op, char* prompt) {
+/**
+ * @brief Handle one line of input: a command, or an expression, operation or both
+ *
+ * The prompt has *len* characters and doesn't need to be terminated, so it can point straight into the input
+ */
+void process_prompt(operation** current_op, const char* prompt, size_t len) {
 
     // Process input
 
     // Try to find a known command and handle it
-    if (!strcmp(prompt, "quit") || !strcmp(prompt, "q") || !strcmp(prompt, "exit"))
+    if (is_command(prompt, len, "quit") || is_command(prompt, len, "q") || is_command(prompt, len, "exit"))
         exit_pcalc(0);
 
-    else if (!strcmp(prompt, "binary"))
+    else if (is_command(prompt, len, "binary"))
         binary_enabled = !binary_enabled;
 
-    else if (!strcmp(prompt, "hex"))
+    else if (is_command(prompt, len, "hex"))
         hex_enabled = !hex_enabled;
 
-    else if (!strcmp(prompt, "ascii"))
+    else if (is_command(prompt, len, "ascii"))
         ascii_enabled = !ascii_enabled;
 
-    else if (!strcmp(prompt, "decimal"))
+    else if (is_command(prompt, len, "decimal"))
         decimal_enabled = !decimal_enabled;
 
-    else if (!strcmp(prompt, "history"))
+    else if (is_command(prompt, len, "history"))
         history_enabled = !history_enabled;
 
-    else if (!strcmp(prompt, "operation"))
+    else if (is_command(prompt, len, "operation"))
         operation_enabled = !operation_enabled;
 
-    else if (strstr(prompt, "bit") != NULL) {
+    else if (is_command(prompt, len, "stats")) {
+        stats_pane_enabled = !stats_pane_enabled;
 
-        // Command to change the number of bits
+        // Batch workers don't show the pane, and the timers must not change while they run
+        if (use_interface)
+            stats_timers_enabled = 1;
+    }
 
-        int requestedmasksize = atoi(prompt);
-        globalmasksize = requestedmasksize > DEFAULT_MASK_SIZE || requestedmasksize <= 0 ? DEFAULT_MASK_SIZE : requestedmasksize;
+    else if (memmem(prompt, len, "bit", 3) != NULL) {
 
-        //globalmask cant be 0x16f's
-        globalmask = shr((DEFAULT_MASK_SIZE-globalmasksize), DEFAULT_MASK);
+        // Command to change the number of bits
 
-        // apply mask to all numbers in stack
-        numberstack* aux = create_numberstack(numbers->size);
-        for (int i=0; i<numbers->size; i++)
-            push_numberstack(aux, *pop_numberstack(numbers) & globalmask);
+        int previous_masksize = globalmasksize;
+        set_globalmasksize(requested_masksize(prompt, len));
 
-        for (int i=0; i<aux->size; i++)
-            push_numberstack(numbers, *pop_numberstack(aux) & globalmask);
+        // apply mask to all numbers in stack
+        mask_numberstack(numbers, previous_masksize);
 
     }
 
@@ -246,7 +428,7 @@ static void process_prompt(operation** current_op, char* prompt) {
 
 
         // Remove any unknown characters from prompt
-        char* input = sanitize(prompt);
+        char* input = sanitize(prompt, len);
 
         // We need to check if the last token is an operation before it gets freed,
         // And save it, to set it as the current op after the input is processed
@@ -266,31 +448,29 @@ static void process_prompt(operation** current_op, char* prompt) {
 
         int inputlen = strlen(input);
 
-        if (input[0] != '\0' && strchr(ALL_OPS, input[0]) &&
-                (inputlen == 1 || (input[0] != NOT_SYMBOL && input[0] != TWOSCOMPLEMENT_SYMBOL && input[0] != SWAPENDIANNESS_SYMBOL))) {
+        if (input[0] != '\0' && getopcode(input[0]) &&
+                (inputlen == 1 || getopcode(input[0])->noperands == 2)) {
 
-            // The input is either just an op, or an expression that starts with an op that isn't a prefix | case 1 or case 3
+            // The input is either just an op, or an expression that starts with an op that takes two operands | case 1 or case 3
+            // (an op with one operand at the start is part of the expression, i.e. "~1")
 
             // Set the current operation as the operation structure for that symbol
             *current_op = getopcode(input[0]);
 
             // Add the operation to history
-            char opchar[2] = {input[0], '\0'};
+            char opchar[MAX_KEYWORD_LEN + 1];
+            format_operation(opchar, *current_op);
             add_to_history(&history, opchar);
 
-            // Duplicate the *tokens* string starting from the immediate next position, and free previous tokens afterwards
-            char* tokens_wout_op = strdup(input+1);
-
-            free(input);
-
-            input = tokens_wout_op;
+            // Skip the op - the *tokens* string now starts from the immediate next position
+            input++;
 
             // The length of the input is now 1 character smaller
             inputlen--;
 
         }
 
-        if (inputlen > 0 && strchr(ALL_OPS, input[inputlen-1])) {
+        if (inputlen > 0 && getopcode(input[inputlen-1])) {
 
             // Last char is an op | case 2
 
@@ -303,7 +483,7 @@ static void process_prompt(operation** current_op, char* prompt) {
         }
 
         if (*current_op == NULL ||
-                (prompt[0] == '\0' && !(*current_op = NULL))) {
+                (len == 0 && !(*current_op = NULL))) {
 
             // There's no current operation and we're going to process a new number
             // -> clear the stack and history before processing it
@@ -317,21 +497,24 @@ static void process_prompt(operation** current_op, char* prompt) {
         if (inputlen > 0) {
 
             // Add the tokens to history as a whole, for now...
-            add_to_history(&history, input);
+            add_to_history(&history, expand_keywords(input));
 
-            // Parse the tokens into an expression
-            // This function will free *tokens*
-            exprtree expression = parse(input);
+            if (globalmasksize > DEFAULT_MASK_SIZE) {
 
-            // Calculate the result of the expression
-            // The globalmask is applied inside calculate
-            uint64_t result = calculate(expression);
+                // Numbers of more than 64 bits are calculated from the tree every time
+                wide result;
+                evaluate_wide(input, &result);
+                push_wide_numberstack(numbers, &result);
+            }
+            else {
 
-            // The expression is no longer needed since we have its value
-            free_exprtree(expression);
+                // Calculate the result of the expression, reusing the compiled program if it was seen before
+                // The globalmask is applied inside the evaluation and *tokens* are released afterwards
+                uint64_t result = evaluate(input);
 
-            // Push result to the numberstack
-            push_numberstack(numbers, result);
+                // Push result to the numberstack
+                push_numberstack(numbers, result);
+            }
 
             if (suffix_op != NULL) {
 
@@ -343,15 +526,16 @@ static void process_prompt(operation** current_op, char* prompt) {
                 // Set a new operation from the symbol
                 *current_op = suffix_op;
 
-                char opchar[2] = {suffix_op->character, '\0'};
+                char opchar[MAX_KEYWORD_LEN + 1];
+                format_operation(opchar, suffix_op);
                 add_to_history(&history, opchar);
             }
 
         }
         else {
             // The input expression generated an empty token string.
-            // Because parse() isn't called, we must free *tokens* manually
-            free(input);
+            // Because parse() isn't called, we must release *tokens* manually
+            arena_reset(&eval_arena);
             total_tokens_freed++;
         }
 
@@ -374,20 +558,54 @@ static void process_prompt(operation** current_op, char* prompt) {
 }
 
 
+/**
+ * @brief Byte order given to --raw-in or --raw-out (MAP_RAW_LE or MAP_RAW_BE), the program exits if it's unknown
+ */
+static int get_byte_order(const char* order) {
+
+    if (!strcmp(order, "le"))
+        return MAP_RAW_LE;
+    else if (!strcmp(order, "be"))
+        return MAP_RAW_BE;
+
+    fprintf(stderr, "pcalc: unknown byte order '%s' (use le or be)\n", order);
+    exit(EXIT_FAILURE);
+}
+
+static int is_command(const char* prompt, size_t len, const char* command) {
+
+    return len == strlen(command) && !memcmp(prompt, command, len);
+}
+
 static void apply_operations(numberstack* numbers, operation** current_op) {
 
     if (*current_op != NULL) {
 
         unsigned char noperands = (*current_op)->noperands;
 
-        if (numbers->size >= noperands) {
+        if (numbers->size >= noperands && globalmasksize > DEFAULT_MASK_SIZE) {
+
+            wide operands[2];
+            wide_from_u64(&operands[1], 0);
+
+            for (unsigned char i=0; i < noperands; i++)
+                wide_copy(&operands[i], pop_wide_numberstack(numbers));
+
+            (*current_op)->wide_execute(&operands[0], &operands[0], &operands[1]);
+            wide_mask(&operands[0]);
+
+            push_wide_numberstack(numbers, &operands[0]);
+
+            *current_op = NULL; // Set to invalid operation
+        }
+        else if (numbers->size >= noperands) {
 
             uint64_t operands[2] = {0};
 
             for (unsigned char i=0; i < noperands; i++)
                 operands[i] = *pop_numberstack(numbers);
 
-            uint64_t result = (*current_op)->execute(operands[0], operands[1]) & globalmask;
+            uint64_t result = (*current_op)->execute[active_kernels](operands[0], operands[1]);
 
             push_numberstack(numbers, result);
 
@@ -400,45 +618,72 @@ static void apply_operations(numberstack* numbers, operation** current_op) {
 
 static void get_input(char* in) {
 
-    char inp;
     int history_counter = searchHistory.size;
 
-    // Is the cursor at the end of the line or somewhere in the middle
-    int browsing = 0;
+    // The key that ended a search, handled before the next one is read
+    int pending = 0;
+
+    // Position of the cursor and length of the input
+    int pos = 0, len = 0;
 
     // Collect input until enter is pressed
-    for (int pos = 0, len = 0; (inp = getchar()) != 13 && inp != '\n';) {
+    for (;;) {
+
+        int key = pending ? pending : read_key(in, pos);
+        pending = 0;
 
         // Get max possible input length
         int max = getmaxx(inputwin) - INPUT_START;
 
-        int searched = 0;
+        if (pasting) {
+
+            /* Pasted text is inserted as it is, without any of the keys below,
+             * except that a new line ends the input (the rest of the paste goes to the next one)
+             */
+            if (key == KEY_PASTE_END)
+                pasting = 0;
+            else if (key == '\n' || key == '\r')
+                break;
+            else if (key >= ' ' && key < 256 && len < MAX_IN && len <= max)
+                insert_key(in, &pos, &len, key);
+
+            continue;
+        }
+
+        if (key == '\n' || key == '\r' || key == KEY_ENTER)
+            break;
 
         /* Check for forbidden keys
-         * -1 is a key that indicates the terminal got resized
+         * KEY_RESIZE is a key that indicates the terminal got resized
          *  5 is a key that indicates mouse wheel down
          *  25 is a key that indicates mouse wheel up
-         *  27 is a key that indicates an arrow key was pressed
-         *  127 is a key that indicates the brackspace key was pressed
+         *  27 is a key that indicates an escape sequence that isn't a known key
          */
-        switch(inp) {
+        switch (key) {
 
-            case -1:
+            case KEY_RESIZE:
                 update_win_borders(numbers);
+                break;
+
+            case ERR:
             case 25:
-                continue;
+            case 27:
+                break;
+
+            case KEY_PASTE_START:
+                pasting = 1;
                 break;
 
             case 1:
                 //CTRL-A
+            case KEY_HOME:
                 pos = 0;
-                browsing = searched = 1;
                 break;
+
             case 5:
                 //CTRL-E
+            case KEY_END:
                 pos = len;
-                browsing = 0;
-                searched = 1;
                 break;
 
             case 4:
@@ -449,178 +694,237 @@ static void get_input(char* in) {
             case 12:
                 //CTRL-L
                 clear_history();
-                pos = len = 0;
                 in[0] = '\0';
                 return;
-                break;
 
             case 8:
                 //CTRL-Backspace
-            case 23:
+            case 23: {
                 //CTRL-W
-                inp = '\0';
-                if(pos == 0)
-                    continue;
+                // Delete the spaces before the cursor, then the word before them
+                int start = pos;
+                while (start > 0 && in[start-1] == ' ')
+                    start--;
+                while (start > 0 && in[start-1] != ' ')
+                    start--;
+
+                memmove(in + start, in + pos, len - pos + 1);
+                len -= pos - start;
+                pos = start;
+                break;
+            }
 
-                int jump = 0; //Amount of characters removed
-                while(in[pos-1] == ' ' && pos > 0) { //Delete trailing spaces
-                    pos--; len--; //Delete 1 character
-                    jump++;
-                }
-                while(in[pos-1] != ' ' && pos > 0) { //Delete last typed word
-                    pos--; len--;
-                    jump++;
-                }
+            case 18:
+                //CTRL-R
+                pending = search_input(in);
+                pos = len = strlen(in);
+                break;
 
-                if(browsing) {
-                    for (int i = pos; i <= len + jump; i++) {
-                        in[i] = in[i + jump - 1];
-                    }
-                }
+            case KEY_UP:
+                browsehistory(in, -1, &history_counter);
+                pos = len = strlen(in);
+                break;
 
-                in[len + 1] = '\0';
+            case KEY_DOWN:
+                browsehistory(in, 1, &history_counter);
+                pos = len = strlen(in);
+                break;
 
+            case KEY_RIGHT:
+                if (pos < len)
+                    pos++;
                 break;
 
-            case 27:
-                getchar();
-                inp = getchar();
-                switch (inp) {
-
-                    case 'A':
-                        // Up arrow
-                        browsehistory(in, -1, &history_counter);
-                        len = strlen(in);
-                        searched = 1;
-                        browsing = 0;
-
-                        break;
-
-                    case 'B':
-                        // Down arrow
-                        browsehistory(in, 1, &history_counter);
-                        len = strlen(in);
-                        searched = 1;
-                        browsing = 0;
-
-                        break;
-
-                    case 'C':
-                        // Right arrow
-                        if (browsing) {    // The right arrow should only work while in the middle of the input
-                            pos++;
-
-                            // Exit browsing mode if the cursor is at the end of the input
-                            if (pos == len) {
-                                browsing = 0;
-                            }
-                        }
-                        searched = 1;
-
-                        break;
-
-                    case 'D':
-                        // Left arrow
-                        if (pos != 0) {
-                            pos--;
-                            browsing = 1; // The left arrow will always be in browsing mode, so no need for a check
-                        }
-                        searched = 1;
-
-                        break;
-                }
+            case KEY_LEFT:
+                if (pos > 0)
+                    pos--;
                 break;
 
             case 127:
-                // Backspace
-
-                if (pos != 0) {
+            case KEY_BACKSPACE:
+                if (pos > 0) {
+                    memmove(in + pos - 1, in + pos, len - pos + 1);
                     pos--;
                     len--;
-                    inp = '\0';
-                }
-                else {
-                    // Skip printing if backspace was pressed but nothing was done, otherwise a strange undefined character is printed
-                    searched = 1;
                 }
                 break;
 
+            default:
+                // Prevent user to input more than MAX_IN, or more than fits in the window
+                if (key < 256 && len < MAX_IN && len <= max)
+                    insert_key(in, &pos, &len, key);
+                break;
         }
+    }
 
-        // Prevent user to input more than MAX_IN
-        if(!searched && len <= MAX_IN && (len <= max || !use_interface)) {
-            if (!browsing) {
-                // If the cursor is at the end of the text
+    // Consecutive duplicates are neither kept nor written to the file
+    if (in[0] != '\0' && add_to_history(&searchHistory, in))
+        append_history_file(in);
 
-                // Append char to in array
-                in[pos] = inp;
-                in[++pos] = '\0';
-                len++; // Make sure that len is still equal to pos
+}
 
-                if (inp == '\0') {
-                    // Clear screen from previous input
-                    sweepline(inputwin, 1, 22 + --len);
-                }
-            }
-            else {
-                // If the cursor is in the text, not at the end
+/**
+ * @brief Wait for the next key, but draw the input first if there are no keys queued
+ *
+ * All the keys that are already queued (i.e. pasted, or typed while drawing) are handled before
+ * the screen is updated again. A paste is drawn once it ends
+ */
+static int read_key(const char* in, int pos) {
 
-                if (inp == '\0') {
-                    // Backspace
+    wtimeout(inputwin, 0);
+    int key = wgetch(inputwin);
+    wtimeout(inputwin, -1);
 
-                    // Move all of in after pos one space back
-                    for (int i = pos; i <= len; i++) {
-                        in[i] = in[i + 1];
-                    }
+    if (key == ERR) {
 
-                    sweepline(inputwin, 1, 22 + len);
-                }
-                else {
-                    // Everything except backspace
+        if (!pasting)
+            draw_input(in, pos);
+
+        key = wgetch(inputwin);
+    }
+
+    return key;
+}
+
+/**
+ * @brief Search the inputs for what's typed (Ctrl-R), from the newest one back, and leave the match in *in*
+ *
+ * Ctrl-R again finds an older match, and Ctrl-G or Escape go back to the input from before the search.
+ * Returns the key that ended the search, which is handled as usual (ERR when it was cancelled)
+ */
+static int search_input(char* in) {
+
+    char saved[MAX_IN + 1];
+    strcpy(saved, in);
+
+    char query[MAX_IN];
+    int qlen = 0;
+    int match = -1, found = 1, pos = strlen(in);
+
+    for (;;) {
+
+        printsearch(query, qlen, found);
+        int key = read_key(in, pos);
+
+        int before;
+        switch (key) {
 
-                    // Move all of in after pos one space forward to make room for the new input
-                    len++;
-                    for (int i = len; i > pos; i--) {
-                        in[i] = in[i - 1];
-                    }
-                    // Append char to in array
-                    in[pos++] = inp;
+            case KEY_RESIZE:
+                update_win_borders(numbers);
+                continue;
 
+            case ERR:
+                continue;
+
+            case 7:
+                //CTRL-G
+            case 27:
+                strcpy(in, saved);
+                printsearch(NULL, 0, 0);
+                return ERR;
+
+            case 18:
+                //CTRL-R
+                if (qlen == 0 || match < 0)
+                    continue;
+                before = match;
+                break;
+
+            case 8:
+            case 127:
+            case KEY_BACKSPACE:
+                if (qlen == 0)
+                    continue;
+                qlen--;
+                before = search_records();
+                break;
+
+            default:
+                if (key < ' ' || key >= 256 || qlen == MAX_IN) {
+                    printsearch(NULL, 0, 0);
+                    return key == '\r' || key == KEY_ENTER ? '\n' : key;
                 }
-            }
-        }
-        // This saves having to increment pos everytime len is incremented when youre not browsing
-        if (!browsing) { pos = len; }
 
-        // Clear input (only necessary because of the history feature)
-        sweepline(inputwin, 1, 22);
+                // The match so far can still have the longer query
+                query[qlen++] = key;
+                before = match >= 0 ? match + 1 : search_records();
+                break;
+        }
 
-        // Finaly print input
-        if (use_interface)
-            mvwprintw_colors(inputwin, 1, 22, COLOR_PAIR_DEFAULT, "%s", in);
-        else
-            mvwprintw(inputwin, 1, 22, "%s", in);
+        int id = before, n = 0;
+        const char* text = NULL;
+        while ((id = search_history(query, qlen, id)) >= 0) {
 
-        wmove(inputwin, 1, 22 + pos); // Move the cursor
+            // A match with the same text as the one shown isn't shown again
+            text = search_record(id, &n);
+            if (key != 18 || n != (int) strlen(in) || memcmp(text, in, n))
+                break;
+        }
 
-        wrefresh(inputwin);
+        found = qlen == 0 || id >= 0;
 
+        if (qlen == 0) {
+            match = -1;
+            strcpy(in, saved);
+            pos = strlen(in);
+        }
+        else if (id >= 0) {
+            match = id;
+            memcpy(in, text, n);
+            in[n] = '\0';
+            pos = (char*) memmem(in, n, query, qlen) - in;
+        }
     }
+}
 
-    if (in[0] != '\0' && (searchHistory.size == 0 || strcmp(in, searchHistory.records[searchHistory.size - 1]))) {
-        add_to_history(&searchHistory, in);
-    }
+static void insert_key(char* in, int* pos, int* len, int key) {
 
+    memmove(in + *pos + 1, in + *pos, *len - *pos + 1);
+    in[(*pos)++] = key;
+    (*len)++;
+}
+
+/**
+ * @brief Print the input and its preview, and send them to the terminal with anything drawn before
+ */
+static void draw_input(const char* in, int pos) {
+
+    // Clear input (only necessary because of the history feature)
+    sweepline(inputwin, 1, 22);
+
+    mvwprintw_colors(inputwin, 1, 22, COLOR_PAIR_DEFAULT, "%s", in);
+
+    // Value of the input so far, only the part after what changed is calculated again
+    printpreview(in, strlen(in));
+
+    wmove(inputwin, 1, 22 + pos); // Move the cursor
+
+    wnoutrefresh(inputwin);
+    doupdate();
 }
 
 
 void exit_pcalc(int code) {
 
+    if (use_interface) {
+        putp(BRACKETED_PASTE_OFF);
+        endwin();
+    }
+    else
+        flush_batch_output();
+
+    // Before anything is freed, so the statistics show the memory still in use
+    if (stats_enabled)
+        print_stats();
+
     free_history(&history);
     free_history(&searchHistory);
-    free_numberstack(numbers);
+    close_history_file();
+    if (numbers != NULL)
+        free_numberstack(numbers);
+    free_arena(&eval_arena);
 
-    endwin();
+    clear_cache();
 
     switch (code) {
 
@@ -637,3 +941,4 @@ static void exit_pcalc_success() {
 
     exit_pcalc(0);
 }
+
@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "bytecode.h"
+#include "format.h"
+#include "global.h"
+#include "lexer.h"
+#include "map.h"
+#include "operators.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "xmalloc.h"
+
+/*
+ * Map mode (--map EXPR)
+ *
+ * The expression is compiled once, with x standing for a variable, and evaluated for every number
+ * read from the input, one per line. Numbers are collected in blocks of BYTECODE_LANES values, and
+ * each block is calculated with run_bytecode_lanes(), which applies every operator to the whole block
+ *
+ * With --raw-in and --raw-out, numbers are read and written as packed words of the current number of bits
+ * instead, little or big endian, so no text is parsed nor formatted
+ */
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MAP_RAW_NATIVE MAP_RAW_BE
+#else
+#define MAP_RAW_NATIVE MAP_RAW_LE
+#endif
+
+static _Alignas(MAP_RAW_ALIGNMENT) uint64_t values[BYTECODE_LANES];
+static _Alignas(MAP_RAW_ALIGNMENT) uint64_t results[BYTECODE_LANES];
+static int nvalues = 0;
+
+// Raw words read from the input, and the results packed the same way
+static _Alignas(MAP_RAW_ALIGNMENT) unsigned char raw_input[MAP_RAW_IN_SIZE];
+static _Alignas(MAP_RAW_ALIGNMENT) unsigned char raw_output[BYTECODE_LANES * sizeof(uint64_t)];
+
+static exprtree expression;
+static const bytecode* program;
+static int output_base;
+static int input_order;
+static int output_order;
+static size_t word_size;
+
+// The swap endianness operator, which swaps the bytes of words of the current number of bits
+static uint64_t (*swap_word)(uint64_t, uint64_t);
+
+static unsigned long nlines = 0;
+static int invalid_lines = 0;
+
+static void map_text(FILE*);
+static void map_raw(FILE*);
+static void map_line(const char*, size_t);
+static void map_block();
+static void load_words(const unsigned char*, uint64_t*, size_t);
+static void store_words(const uint64_t*, unsigned char*, size_t);
+
+
+/**
+ * @brief Write *expression* calculated for every number in *in* to stdout, in the given base (NTYPE_*)
+ *
+ * Numbers can be written in any base the calculator accepts, and can start with a minus sign.
+ * Empty lines are skipped, and lines that aren't a number are reported to stderr and skipped.
+ * The input and the output can be raw words instead of text (MAP_RAW_LE or MAP_RAW_BE), then the
+ * base isn't used. An expression that is just an operator with one operand is applied to x.
+ * Never returns: the program exits at the end of the input
+ */
+void run_map(const char* expr, FILE* in, int base, int input_format, int output_format) {
+
+    variables_enabled = 1;
+    output_base = base;
+    input_order = input_format;
+    output_order = output_format;
+    word_size = globalmasksize / 8;
+    swap_word = getopcode(SWAPENDIANNESS_SYMBOL)->execute[active_kernels];
+
+    char* tokens = sanitize(expr, strlen(expr));
+    if (*tokens == '\0') {
+        fprintf(stderr, "pcalc: invalid map expression '%s'\n", expr);
+        exit_pcalc(EXIT_FAILURE);
+    }
+
+    if (tokens[1] == '\0' && getopcode(tokens[0]) && getopcode(tokens[0])->noperands == 1) {
+        tokens[1] = VARIABLE_SYMBOL;
+        tokens[2] = '\0';
+    }
+
+    // The expression stays in the evaluation arena until the end
+    expression = optimize_exprtree(parse(tokens));
+    // Expressions too deep for the interpreter are calculated from the tree for each value
+    program = compile_exprtree(expression, &eval_arena);
+
+    if (input_order == MAP_TEXT)
+        map_text(in);
+    else
+        map_raw(in);
+
+    map_block();
+
+    free_exprtree(expression);
+
+    exit_pcalc(invalid_lines ? EXIT_FAILURE : 0);
+}
+
+/**
+ * @brief Read the numbers of the input, one per line
+ */
+static void map_text(FILE* in) {
+
+    char* block = xmalloc(BATCH_IN_SIZE);
+
+    // Characters of the current line that were read in the previous block(s)
+    char line[MAX_IN + 1];
+    size_t linelen = 0;
+
+    size_t nread;
+    while ((nread = fread(block, 1, BATCH_IN_SIZE, in)) > 0) {
+
+        char* start = block;
+        char* end = block + nread;
+
+        char* newline;
+        while ((newline = memchr(start, '\n', end - start)) != NULL) {
+
+            if (linelen == 0)
+                // The whole line is in the block
+                map_line(start, newline - start);
+            else {
+                size_t len = newline - start;
+                if (len > MAX_IN - linelen)
+                    len = MAX_IN - linelen;
+
+                memcpy(line + linelen, start, len);
+                map_line(line, linelen + len);
+                linelen = 0;
+            }
+
+            start = newline + 1;
+        }
+
+        // Keep the incomplete line at the end of the block for the next read
+        size_t len = end - start;
+        if (len > MAX_IN - linelen)
+            len = MAX_IN - linelen;
+
+        memcpy(line + linelen, start, len);
+        linelen += len;
+    }
+
+    xfree(block);
+
+    // The last line might not end with a newline
+    if (linelen > 0)
+        map_line(line, linelen);
+}
+
+/**
+ * @brief Read the numbers of the input as packed words
+ */
+static void map_raw(FILE* in) {
+
+    // Bytes of a word that was cut at the end of the previous read
+    size_t pending = 0;
+
+    size_t nread;
+    while ((nread = fread(raw_input + pending, 1, MAP_RAW_IN_SIZE - pending, in)) > 0) {
+
+        size_t nwords = (pending + nread) / word_size;
+
+        for (size_t i = 0; i < nwords; ) {
+
+            size_t n = BYTECODE_LANES - nvalues;
+            if (n > nwords - i)
+                n = nwords - i;
+
+            load_words(raw_input + i * word_size, values + nvalues, n);
+            nvalues += n;
+            i += n;
+
+            if (nvalues == BYTECODE_LANES)
+                map_block();
+        }
+
+        pending = pending + nread - nwords * word_size;
+        memmove(raw_input, raw_input + nwords * word_size, pending);
+    }
+
+    if (pending > 0) {
+        fprintf(stderr, "pcalc: the input ends with an incomplete %d bit word\n", globalmasksize);
+        invalid_lines = 1;
+    }
+}
+
+/**
+ * @brief Read the number in a line of input into the current block
+ */
+static void map_line(const char* line, size_t len) {
+
+    nlines++;
+
+    size_t pos = 0;
+    while (pos < len && (line[pos] == ' ' || line[pos] == '\t'))
+        pos++;
+
+    // Accept CRLF line endings
+    while (len > pos && (line[len-1] == '\r' || line[len-1] == ' ' || line[len-1] == '\t'))
+        len--;
+
+    if (pos == len)
+        return;
+
+    int negative = line[pos] == '-';
+    if (negative)
+        pos++;
+
+    uint64_t value;
+    int ndigits = lex_literal(line + pos, len - pos, &value);
+
+    if (ndigits == 0 || pos + ndigits != len) {
+        fprintf(stderr, "pcalc: line %lu: invalid number '%.*s'\n", nlines, (int) len, line);
+        invalid_lines = 1;
+        return;
+    }
+
+    values[nvalues++] = negative ? -value : value;
+
+    if (nvalues == BYTECODE_LANES)
+        map_block();
+}
+
+/**
+ * @brief Calculate the expression for all the values in the current block and write the results
+ */
+static void map_block() {
+
+    if (program != NULL)
+        run_bytecode_lanes(program, values, results, nvalues);
+    else
+        for (int i = 0; i < nvalues; i++) {
+            variable_value = values[i];
+            results[i] = calculate(expression);
+        }
+
+    if (output_order != MAP_TEXT) {
+        store_words(results, raw_output, nvalues);
+        batch_write((char*) raw_output, nvalues * word_size);
+        nvalues = 0;
+        return;
+    }
+
+    for (int i = 0; i < nvalues; i++) {
+
+        char str[FORMAT_BUFFER_SIZE];
+        int len = format_number(str, results[i], output_base);
+        str[len++] = '\n';
+
+        batch_write(str, len);
+    }
+
+    nvalues = 0;
+}
+
+/**
+ * @brief Read *n* words from *in*, in the byte order of the input
+ */
+static void load_words(const unsigned char* in, uint64_t* out, size_t n) {
+
+    // Words are copied in the native byte order first
+    for (size_t i = 0; i < n; i++) {
+        switch (word_size) {
+            case 1: out[i] = in[i]; break;
+            case 2: { uint16_t w; memcpy(&w, in + 2*i, 2); out[i] = w; break; }
+            case 4: { uint32_t w; memcpy(&w, in + 4*i, 4); out[i] = w; break; }
+            default: memcpy(out + i, in + 8*i, 8);
+        }
+    }
+
+    if (input_order != MAP_RAW_NATIVE)
+        for (size_t i = 0; i < n; i++)
+            out[i] = swap_word(out[i], 0);
+}
+
+/**
+ * @brief Write *n* words to *out*, in the byte order of the output
+ */
+static void store_words(const uint64_t* in, unsigned char* out, size_t n) {
+
+    for (size_t i = 0; i < n; i++) {
+
+        uint64_t v = output_order != MAP_RAW_NATIVE ? swap_word(in[i], 0) : in[i];
+
+        switch (word_size) {
+            case 1: out[i] = v; break;
+            case 2: { uint16_t w = v; memcpy(out + 2*i, &w, 2); break; }
+            case 4: { uint32_t w = v; memcpy(out + 4*i, &w, 4); break; }
+            default: memcpy(out + 8*i, &v, 8);
+        }
+    }
+}
@@ -1,11 +1,14 @@
 #include <stdlib.h>
 
 #include "numberstack.h"
+#include "operators.h"
 #include "xmalloc.h"
 #include "global.h"
+#include "stats.h"
+#include "wide.h"
 
 
-numberstack* numbers;
+_Thread_local numberstack* numbers;
 
 
 // Allocate and set up numberstack
@@ -15,6 +18,7 @@ numberstack * create_numberstack(int max_size) {
     s = xmalloc(sizeof(numberstack));
     void* allocated[] = { s };
     s->elements = xmalloc_with_ressources(max_size * sizeof(*s->elements), allocated, 1);
+    s->wides = NULL;
     s->size = 0;
     s->max_size = max_size;
     return s;
@@ -23,12 +27,24 @@ numberstack * create_numberstack(int max_size) {
 static numberstack * resize_numberstack(numberstack* s) {
 
     s->max_size *= 2;
+    stats.stack_resizes++;
     void* allocated[] = { s };
     s->elements = xrealloc_with_ressources(s->elements, s->max_size * sizeof(*s->elements), allocated, 1);
+    if (s->wides != NULL)
+        s->wides = xrealloc(s->wides, s->max_size * sizeof(*s->wides));
     return s;
 
 }
 
+// The numbers of more than 64 bits, allocated the first time they're used
+static wide * wide_elements(numberstack* s) {
+
+    if (s->wides == NULL)
+        s->wides = xmalloc(s->max_size * sizeof(*s->wides));
+
+    return s->wides;
+}
+
 // Pop element from the top of the stack (return and remove element)
 uint64_t * pop_numberstack(numberstack* s) {
 
@@ -53,7 +69,68 @@ void push_numberstack(numberstack* s, uint64_t value) {
     if (s->size == s->max_size)
         resize_numberstack(s);
 
+    // With more than 64 bits the number is zero extended
+    if (globalmasksize > DEFAULT_MASK_SIZE)
+        wide_from_u64(&wide_elements(s)[s->size], value);
+
     s->elements[s->size++] = value;
+
+    if (s->size > stats.peak_stack_size)
+        stats.peak_stack_size = s->size;
+}
+
+// Pop a number of more than 64 bits from the top of the stack
+wide * pop_wide_numberstack(numberstack* s) {
+
+    if (s->size == 0)
+        return NULL;
+
+    s->size--;
+    return &s->wides[s->size];
+}
+
+// Return the number of more than 64 bits at the top of the stack without removing it
+wide * top_wide_numberstack(numberstack* s) {
+
+    if (s->size == 0)
+        return NULL;
+
+    return &s->wides[s->size-1];
+}
+
+// Push a number of more than 64 bits to the top of the stack
+void push_wide_numberstack(numberstack* s, const wide* value) {
+
+    if (s->size == s->max_size)
+        resize_numberstack(s);
+
+    wide_copy(&wide_elements(s)[s->size], value);
+    s->elements[s->size++] = value->limbs[0];
+
+    if (s->size > stats.peak_stack_size)
+        stats.peak_stack_size = s->size;
+}
+
+// Keep only the bits of the current number of bits in every number, which had *previous_masksize* bits
+void mask_numberstack(numberstack* s, int previous_masksize) {
+
+    if (globalmasksize > DEFAULT_MASK_SIZE) {
+
+        wide* w = wide_elements(s);
+
+        for (int i = 0; i < s->size; i++) {
+            if (previous_masksize > DEFAULT_MASK_SIZE)
+                wide_extend(&w[i], previous_masksize);
+            else
+                wide_from_u64(&w[i], s->elements[i]);
+            wide_mask(&w[i]);
+            s->elements[i] = w[i].limbs[0];
+        }
+    }
+    else {
+        for (int i = 0; i < s->size; i++)
+            s->elements[i] &= globalmask;
+    }
 }
 
 // Clear the stack
@@ -64,6 +141,7 @@ void clear_numberstack(numberstack* s) {
 
 void free_numberstack(numberstack *s) {
 
+    xfree(s->wides);
     xfree(s->elements);
     xfree(s);
 
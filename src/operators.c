@@ -1,10 +1,21 @@
+#include <ctype.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "operators.h"
+#include "wide.h"
+
+_Thread_local uint64_t globalmask = DEFAULT_MASK;
+_Thread_local int globalmasksize = DEFAULT_MASK_SIZE;
 
-uint64_t globalmask = DEFAULT_MASK;
-int globalmasksize = DEFAULT_MASK_SIZE;
+// The kernels of the current number of bits (KERNELS_*), set with it by set_globalmasksize()
+_Thread_local int active_kernels = KERNELS_64;
 
 operation *current_op = NULL;
 
@@ -22,49 +33,328 @@ static uint64_t modulus(uint64_t, uint64_t);
 static uint64_t not(uint64_t, uint64_t);
 static uint64_t twos_complement(uint64_t, uint64_t);
 static uint64_t swap_endianness(uint64_t, uint64_t);
-
-static operation operations[16] = {
-    {ADD_SYMBOL, 2, add},
-    {SUB_SYMBOL, 2, subtract},
-    {MUL_SYMBOL, 2, multiply},
-    {DIV_SYMBOL, 2, divide},
-    {AND_SYMBOL, 2, and},
-    {OR_SYMBOL, 2, or},
-    {NOR_SYMBOL, 2, nor},
-    {XOR_SYMBOL, 2, xor},
-    {SHL_SYMBOL, 2, shl},
-    {SHR_SYMBOL, 2, shr},
-    {ROL_SYMBOL, 2, rol},
-    {ROR_SYMBOL, 2, ror},
-    {MOD_SYMBOL, 2, modulus},
-    {NOT_SYMBOL, 1, not},
-    {TWOSCOMPLEMENT_SYMBOL, 1, twos_complement},
-    {SWAPENDIANNESS_SYMBOL, 1, swap_endianness}
+static uint64_t swap_endianness_8(uint64_t, uint64_t);
+static uint64_t swap_endianness_16(uint64_t, uint64_t);
+static uint64_t swap_endianness_32(uint64_t, uint64_t);
+static uint64_t swap_endianness_64(uint64_t, uint64_t);
+static uint64_t swap_halfword_bytes(uint64_t, uint64_t);
+static uint64_t swap_word_bytes(uint64_t, uint64_t);
+static uint64_t swap_nibbles(uint64_t, uint64_t);
+static uint64_t halfword_bytes(uint64_t);
+static uint64_t word_bytes(uint64_t);
+static uint64_t nibbles(uint64_t);
+static uint64_t whole_units(uint64_t, uint64_t, int, int);
+static uint64_t bit_reverse(uint64_t, uint64_t);
+static uint64_t reverse_bits(uint64_t);
+static void use_kernels(char, uint64_t (*const[NKERNELS])(uint64_t, uint64_t));
+static uint64_t extract_bits(uint64_t, uint64_t);
+static uint64_t deposit_bits(uint64_t, uint64_t);
+static void init_byte_tables();
+
+// The bits of a byte of a value under a byte of mask, packed (extract) or spread (deposit), and the bits
+// set in every byte. Filled in the first time extract_bits() or deposit_bits() runs, by whichever
+// thread gets there first, so they're never filled in when the CPU has BMI2 or PEXT and PDEP aren't used
+static uint8_t extract_table[256][256];
+static uint8_t deposit_table[256][256];
+static uint8_t byte_bits[256];
+static pthread_once_t byte_tables_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Kernels for 8, 16, 32 and 64 bits
+ *
+ * The same operations as the kernels for any number of bits at the end of the file, but the number
+ * of bits is a constant: results are cast to an integer of that size instead of masked with the
+ * globalmask, and rotates don't read the globalmasksize
+ */
+#define DEFINE_KERNELS(BITS, TYPE) \
+    static uint64_t add_##BITS(uint64_t a, uint64_t b) { return (TYPE) (a + b); } \
+    static uint64_t subtract_##BITS(uint64_t a, uint64_t b) { return (TYPE) (b - a); } \
+    static uint64_t multiply_##BITS(uint64_t a, uint64_t b) { return (TYPE) (a * b); } \
+    static uint64_t divide_##BITS(uint64_t a, uint64_t b) { return a ? (TYPE) (b / a) : 0; } \
+    static uint64_t modulus_##BITS(uint64_t a, uint64_t b) { return a ? (TYPE) (b % a) : 0; } \
+    static uint64_t and_##BITS(uint64_t a, uint64_t b) { return (TYPE) (a & b); } \
+    static uint64_t or_##BITS(uint64_t a, uint64_t b) { return (TYPE) (a | b); } \
+    static uint64_t nor_##BITS(uint64_t a, uint64_t b) { return (TYPE) ~(a | b); } \
+    static uint64_t xor_##BITS(uint64_t a, uint64_t b) { return (TYPE) (a ^ b); } \
+    static uint64_t shl_##BITS(uint64_t a, uint64_t b) { return (TYPE) (b << a); } \
+    static uint64_t shr_##BITS(uint64_t a, uint64_t b) { return (TYPE) (b >> a); } \
+    static uint64_t rol_##BITS(uint64_t a, uint64_t b) { return (TYPE) (b << a | (BITS - a < 64 ? b >> (BITS - a) : 0)); } \
+    static uint64_t ror_##BITS(uint64_t a, uint64_t b) { return (TYPE) (b >> a | (BITS - a < 64 ? b << (BITS - a) : 0)); } \
+    static uint64_t not_##BITS(uint64_t a, uint64_t UNUSED(b)) { return (TYPE) ~a; } \
+    static uint64_t twos_complement_##BITS(uint64_t a, uint64_t UNUSED(b)) { return (TYPE) -a; } \
+    static uint64_t swap_halfword_bytes_##BITS(uint64_t a, uint64_t UNUSED(b)) { return (TYPE) whole_units(halfword_bytes(a), a, BITS, 16); } \
+    static uint64_t swap_word_bytes_##BITS(uint64_t a, uint64_t UNUSED(b)) { return (TYPE) whole_units(word_bytes(a), a, BITS, 32); } \
+    static uint64_t swap_nibbles_##BITS(uint64_t a, uint64_t UNUSED(b)) { return (TYPE) nibbles(a); } \
+    static uint64_t bit_reverse_##BITS(uint64_t a, uint64_t UNUSED(b)) { return reverse_bits((TYPE) a) >> (64 - BITS); }
+
+DEFINE_KERNELS(8, uint8_t)
+DEFINE_KERNELS(16, uint16_t)
+DEFINE_KERNELS(32, uint32_t)
+DEFINE_KERNELS(64, uint64_t)
+
+/*
+ * Kernels that count bits, for a number of *BITS* bits kept by *MASK*
+ *
+ * They're defined once as they are and once for each of the instructions the CPU may have for them,
+ * and init_operations() uses the second ones when it has them. The leading zeros and log2 of zero
+ * are taken apart because __builtin_clzll() of zero is undefined. Log2 of zero has no value, so it's
+ * all ones (-1)
+ */
+#define DEFINE_COUNTING_KERNELS(SUFFIX, BITS, MASK, POPCNT, LZCNT, BMI) \
+    POPCNT static uint64_t popcount##SUFFIX(uint64_t a, uint64_t UNUSED(b)) { return __builtin_popcountll(a & MASK); } \
+    POPCNT static uint64_t parity##SUFFIX(uint64_t a, uint64_t UNUSED(b)) { return __builtin_parityll(a & MASK); } \
+    LZCNT static uint64_t leading_zeros##SUFFIX(uint64_t a, uint64_t UNUSED(b)) { a &= MASK; return a ? __builtin_clzll(a) - (64 - BITS) : BITS; } \
+    LZCNT static uint64_t log2_floor##SUFFIX(uint64_t a, uint64_t UNUSED(b)) { a &= MASK; return a ? (uint64_t) (63 - __builtin_clzll(a)) : MASK; } \
+    BMI static uint64_t trailing_zeros##SUFFIX(uint64_t a, uint64_t UNUSED(b)) { a &= MASK; return a ? __builtin_ctzll(a) : BITS; }
+
+DEFINE_COUNTING_KERNELS(_8, 8, UINT8_MAX, , , )
+DEFINE_COUNTING_KERNELS(_16, 16, UINT16_MAX, , , )
+DEFINE_COUNTING_KERNELS(_32, 32, UINT32_MAX, , , )
+DEFINE_COUNTING_KERNELS(_64, 64, UINT64_MAX, , , )
+DEFINE_COUNTING_KERNELS(, globalmasksize, globalmask, , , )
+
+/*
+ * Kernels that extract the bits of the left operand under the mask on the right to the low bits (PEXT),
+ * and that deposit the low bits of the left operand in the bits of the mask (PDEP)
+ *
+ * Like the counting kernels, they're defined with extract_bits() and deposit_bits(), and with the BMI2
+ * instructions. The results never have more bits than the operands
+ */
+#define DEFINE_EXTRACT_KERNELS(SUFFIX, MASK, EXTRACT, DEPOSIT, BMI2) \
+    BMI2 static uint64_t bit_extract##SUFFIX(uint64_t a, uint64_t b) { return EXTRACT(b & MASK, a & MASK); } \
+    BMI2 static uint64_t bit_deposit##SUFFIX(uint64_t a, uint64_t b) { return DEPOSIT(b & MASK, a & MASK); }
+
+DEFINE_EXTRACT_KERNELS(_8, UINT8_MAX, extract_bits, deposit_bits, )
+DEFINE_EXTRACT_KERNELS(_16, UINT16_MAX, extract_bits, deposit_bits, )
+DEFINE_EXTRACT_KERNELS(_32, UINT32_MAX, extract_bits, deposit_bits, )
+DEFINE_EXTRACT_KERNELS(_64, UINT64_MAX, extract_bits, deposit_bits, )
+DEFINE_EXTRACT_KERNELS(, globalmask, extract_bits, deposit_bits, )
+
+#if defined(__x86_64__)
+#define BIT_INSTRUCTIONS
+#define POPCNT __attribute__((target("popcnt")))
+#define LZCNT __attribute__((target("lzcnt")))
+#define BMI __attribute__((target("bmi")))
+#define BMI2 __attribute__((target("bmi2")))
+
+DEFINE_COUNTING_KERNELS(_hw_8, 8, UINT8_MAX, POPCNT, LZCNT, BMI)
+DEFINE_COUNTING_KERNELS(_hw_16, 16, UINT16_MAX, POPCNT, LZCNT, BMI)
+DEFINE_COUNTING_KERNELS(_hw_32, 32, UINT32_MAX, POPCNT, LZCNT, BMI)
+DEFINE_COUNTING_KERNELS(_hw_64, 64, UINT64_MAX, POPCNT, LZCNT, BMI)
+DEFINE_COUNTING_KERNELS(_hw, globalmasksize, globalmask, POPCNT, LZCNT, BMI)
+
+DEFINE_EXTRACT_KERNELS(_hw_8, UINT8_MAX, _pext_u64, _pdep_u64, BMI2)
+DEFINE_EXTRACT_KERNELS(_hw_16, UINT16_MAX, _pext_u64, _pdep_u64, BMI2)
+DEFINE_EXTRACT_KERNELS(_hw_32, UINT32_MAX, _pext_u64, _pdep_u64, BMI2)
+DEFINE_EXTRACT_KERNELS(_hw_64, UINT64_MAX, _pext_u64, _pdep_u64, BMI2)
+DEFINE_EXTRACT_KERNELS(_hw, globalmask, _pext_u64, _pdep_u64, BMI2)
+#endif
+
+// The kernels of an operation, in the order of KERNELS_*
+#define KERNELS(name) { name##_8, name##_16, name##_32, name##_64, name }
+
+/*
+ * Registry of all operations
+ *
+ * Everything about an operator is in its row: the parser, the input sanitizer, the prompt and the
+ * symbols help are all driven from this table, so adding an operator only takes a new row
+ */
+static operation operations[] = {
+    // symbol               operands  kernels                        wide kernel                name    keyword   precedence   associativity  prefix
+    {ADD_SYMBOL,            2,        KERNELS(add),                  wide_add,                  "ADD",  NULL,     PREC_ADD,    ASSOC_LEFT,    1},
+    {SUB_SYMBOL,            2,        KERNELS(subtract),             wide_subtract,             "SUB",  NULL,     PREC_ADD,    ASSOC_LEFT,    1},
+    {MUL_SYMBOL,            2,        KERNELS(multiply),             wide_multiply,             "MUL",  NULL,     PREC_MUL,    ASSOC_LEFT,    0},
+    {DIV_SYMBOL,            2,        KERNELS(divide),               wide_divide,               "DIV",  NULL,     PREC_MUL,    ASSOC_LEFT,    0},
+    {MOD_SYMBOL,            2,        KERNELS(modulus),              wide_modulus,              "MOD",  NULL,     PREC_MUL,    ASSOC_LEFT,    0},
+    {AND_SYMBOL,            2,        KERNELS(and),                  wide_and,                  "AND",  NULL,     PREC_AND,    ASSOC_LEFT,    0},
+    {OR_SYMBOL,             2,        KERNELS(or),                   wide_or,                   "OR",   NULL,     PREC_OR,     ASSOC_LEFT,    0},
+    {NOR_SYMBOL,            2,        KERNELS(nor),                  wide_nor,                  "NOR",  NULL,     PREC_OR,     ASSOC_LEFT,    0},
+    {XOR_SYMBOL,            2,        KERNELS(xor),                  wide_xor,                  "XOR",  NULL,     PREC_XOR,    ASSOC_LEFT,    0},
+    {NOT_SYMBOL,            1,        KERNELS(not),                  wide_not,                  "NOT",  NULL,     PREC_NONE,   ASSOC_LEFT,    1},
+    {SHL_SYMBOL,            2,        KERNELS(shl),                  wide_shl,                  "SL",   NULL,     PREC_SHIFT,  ASSOC_LEFT,    0},
+    {SHR_SYMBOL,            2,        KERNELS(shr),                  wide_shr,                  "SR",   NULL,     PREC_SHIFT,  ASSOC_LEFT,    0},
+    {ROL_SYMBOL,            2,        KERNELS(rol),                  wide_rol,                  "RL",   NULL,     PREC_SHIFT,  ASSOC_LEFT,    0},
+    {ROR_SYMBOL,            2,        KERNELS(ror),                  wide_ror,                  "RR",   NULL,     PREC_SHIFT,  ASSOC_LEFT,    0},
+    {TWOSCOMPLEMENT_SYMBOL, 1,        KERNELS(twos_complement),      wide_twos_complement,      "2's",  NULL,     PREC_NONE,   ASSOC_LEFT,    1},
+    {SWAPENDIANNESS_SYMBOL, 1,        KERNELS(swap_endianness),      wide_swap_endianness,      "SE",   NULL,     PREC_NONE,   ASSOC_LEFT,    1},
+    {SWAPBYTES16_SYMBOL,    1,        KERNELS(swap_halfword_bytes),  wide_swap_halfword_bytes,  "SE16", "rev16",  PREC_NONE,   ASSOC_LEFT,    1},
+    {SWAPBYTES32_SYMBOL,    1,        KERNELS(swap_word_bytes),      wide_swap_word_bytes,      "SE32", "rev32",  PREC_NONE,   ASSOC_LEFT,    1},
+    {SWAPNIBBLES_SYMBOL,    1,        KERNELS(swap_nibbles),         wide_swap_nibbles,         "SN",   "nswap",  PREC_NONE,   ASSOC_LEFT,    1},
+    {POPCOUNT_SYMBOL,       1,        KERNELS(popcount),             wide_popcount,             "POP",  "popcnt", PREC_NONE,   ASSOC_LEFT,    1},
+    {PARITY_SYMBOL,         1,        KERNELS(parity),               wide_parity,               "PAR",  "parity", PREC_NONE,   ASSOC_LEFT,    1},
+    {LEADINGZEROS_SYMBOL,   1,        KERNELS(leading_zeros),        wide_leading_zeros,        "CLZ",  "clz",    PREC_NONE,   ASSOC_LEFT,    1},
+    {TRAILINGZEROS_SYMBOL,  1,        KERNELS(trailing_zeros),       wide_trailing_zeros,       "CTZ",  "ctz",    PREC_NONE,   ASSOC_LEFT,    1},
+    {LOG2_SYMBOL,           1,        KERNELS(log2_floor),           wide_log2_floor,           "LOG",  "log2",   PREC_NONE,   ASSOC_LEFT,    1},
+    {BITREVERSE_SYMBOL,     1,        KERNELS(bit_reverse),          wide_bit_reverse,          "BREV", "brev",   PREC_NONE,   ASSOC_LEFT,    1},
+    {EXTRACT_SYMBOL,        2,        KERNELS(bit_extract),          wide_bit_extract,          "PEXT", "pext",   PREC_AND,    ASSOC_LEFT,    0},
+    {DEPOSIT_SYMBOL,        2,        KERNELS(bit_deposit),          wide_bit_deposit,          "PDEP", "pdep",   PREC_AND,    ASSOC_LEFT,    0},
 };
 
+#define NOPERATIONS ((int) (sizeof(operations) / sizeof(operations[0])))
+
+// Operations indexed by their character
+static operation* registry[256];
+
+/**
+ * @brief Index the operations by their character, must be called before any getopcode()
+ *
+ * Also picks the kernels that count, extract and deposit bits with the instructions this CPU has
+ */
+void init_operations() {
+
+    for (int i = 0; i < NOPERATIONS; i++)
+        registry[(unsigned char) operations[i].character] = &operations[i];
+
+#ifdef BIT_INSTRUCTIONS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("popcnt")) {
+        use_kernels(POPCOUNT_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(popcount_hw));
+        use_kernels(PARITY_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(parity_hw));
+    }
+    if (__builtin_cpu_supports("lzcnt")) {
+        use_kernels(LEADINGZEROS_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(leading_zeros_hw));
+        use_kernels(LOG2_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(log2_floor_hw));
+    }
+    if (__builtin_cpu_supports("bmi"))
+        use_kernels(TRAILINGZEROS_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(trailing_zeros_hw));
+
+    // PEXT and PDEP are microcoded on the first two generations of Zen, and slower than the tables there
+    if (__builtin_cpu_supports("bmi2") && !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2")) {
+        use_kernels(EXTRACT_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(bit_extract_hw));
+        use_kernels(DEPOSIT_SYMBOL, (uint64_t (*[])(uint64_t, uint64_t)) KERNELS(bit_deposit_hw));
+    }
+#endif
+}
+
+/**
+ * @brief Replace the kernels of the operation of a character
+ */
+static void use_kernels(char c, uint64_t (*const kernels[NKERNELS])(uint64_t, uint64_t)) {
+
+    memcpy(getopcode(c)->execute, kernels, sizeof(getopcode(c)->execute));
+}
+
+/**
+ * @brief Get the operation of a character, or NULL if the character isn't an operator
+ */
 operation* getopcode(char c)  {
 
-    for (unsigned long i=0; i < sizeof(operations); i++)
-        if (operations[i].character == c)
+    return registry[(unsigned char) c];
+}
+
+/**
+ * @brief Get the i-th operation of the registry, or NULL after the last one
+ */
+operation* get_operation(int i) {
+
+    return i < NOPERATIONS ? &operations[i] : NULL;
+}
+
+/**
+ * @brief Get the operation whose keyword the *len* characters at *s* start with, or NULL if there's none
+ */
+operation* keyword_operation(const char* s, size_t len) {
+
+    for (int i = 0; i < NOPERATIONS; i++) {
+
+        const char* keyword = operations[i].keyword;
+        if (keyword == NULL || keyword[0] != s[0])
+            continue;
+
+        size_t n = strlen(keyword);
+        if (n <= len && !memcmp(s, keyword, n))
             return &operations[i];
+    }
 
     return NULL;
 }
 
+/**
+ * @brief Write how an operation is typed at *out*, which must have room for MAX_KEYWORD_LEN + 1 characters
+ *
+ * Returns the number of characters written, without the NUL
+ */
+int format_operation(char* out, const operation* op) {
+
+    if (op->keyword == NULL) {
+        out[0] = op->character;
+        out[1] = '\0';
+        return 1;
+    }
+
+    int len = strlen(op->keyword);
+    memcpy(out, op->keyword, len + 1);
+    return len;
+}
+
+/**
+ * @brief Set the number of bits all the values have, and the mask that keeps them
+ */
+void set_globalmasksize(int masksize) {
+
+    globalmasksize = masksize;
+
+    //globalmask cant be 0x16f's
+    if (masksize > DEFAULT_MASK_SIZE)
+        globalmask = DEFAULT_MASK;  // Wider numbers keep all the bits of each limb (see wide_mask())
+    else
+        globalmask = (uint64_t) DEFAULT_MASK >> (DEFAULT_MASK_SIZE - globalmasksize);
+
+    // The kernels are only swapped here, operations don't check the number of bits
+    switch (masksize) {
+        case 8:  active_kernels = KERNELS_8; break;
+        case 16: active_kernels = KERNELS_16; break;
+        case 32: active_kernels = KERNELS_32; break;
+        case 64: active_kernels = KERNELS_64; break;
+        default: active_kernels = KERNELS_ANY; break;
+    }
+}
+
+/**
+ * @brief Number of bits asked for by a bit command: the number it starts with, or 64 if it's out of range
+ *
+ * More than 64 bits, up to WIDE_MAX_BITS, are computed with the wide kernels
+ */
+int requested_masksize(const char* prompt, size_t len) {
+
+    // Read like atoi() would, without the terminated copy it needs: prompts can point into the input
+    size_t i = 0;
+    while (i < len && isspace((unsigned char) prompt[i]))
+        i++;
+
+    if (i < len && (prompt[i] == '+' || prompt[i] == '-')) {
+        if (prompt[i] == '-')
+            return DEFAULT_MASK_SIZE;
+        i++;
+    }
+
+    // Digits after the number is out of range can't bring it back
+    int masksize = 0;
+    for (; i < len && prompt[i] >= '0' && prompt[i] <= '9' && masksize <= WIDE_MAX_BITS; i++)
+        masksize = masksize * 10 + (prompt[i] - '0');
+
+    return masksize > WIDE_MAX_BITS || masksize <= 0 ? DEFAULT_MASK_SIZE : masksize;
+}
+
+
+/*
+ * Kernels for any number of bits, which mask their results with the globalmask
+ */
 
 static uint64_t add(uint64_t a, uint64_t b) {
 
-    return a + b;
+    return (a + b) & globalmask;
 }
 
 // remember op1 = first popped ( right operand ), op2 = second popped ( left operand )
 static uint64_t subtract(uint64_t a, uint64_t b) {
 
-    return b - a;
+    return (b - a) & globalmask;
 }
 static uint64_t multiply(uint64_t a, uint64_t b) {
 
-    return a * b;
+    return (a * b) & globalmask;
 }
 
 static uint64_t divide(uint64_t a, uint64_t b) {
@@ -73,51 +363,51 @@ static uint64_t divide(uint64_t a, uint64_t b) {
     if(!a)
         return 0;
 
-    return b / a;
+    return (b / a) & globalmask;
 }
 
 static uint64_t and(uint64_t a, uint64_t b) {
 
-    return a & b;
+    return a & b & globalmask;
 }
 
 static uint64_t or(uint64_t a, uint64_t b) {
 
-    return a | b;
+    return (a | b) & globalmask;
 }
 
 static uint64_t nor(uint64_t a, uint64_t b) {
 
-    return ~(a | b);
+    return ~(a | b) & globalmask;
 }
 
 static uint64_t xor(uint64_t a, uint64_t b) {
 
-    return a ^ b;
+    return (a ^ b) & globalmask;
 }
 static uint64_t shl(uint64_t a, uint64_t b) {
 
     // Shift longer than type length is undefined behaviour
-    return b << a;
+    return (b << a) & globalmask;
 }
 
 uint64_t shr(uint64_t a, uint64_t b) {
 
     // Shift longer than 64 bits is undefined behaviour
     // don't include shift in tests or //TODO: define behaviour for this calculator
-    return ((uint64_t) b >> a);
+    return ((uint64_t) b >> a) & globalmask;
 }
 
 static uint64_t rol(uint64_t a, uint64_t b) {
 
     // prevent shift by 64 bits because a shift longer than type length is undefined behaviour
-    return b << a | ( globalmasksize - a < 64 ? shr(globalmasksize - a, b) : 0 );
+    return (b << a | ( globalmasksize - a < 64 ? shr(globalmasksize - a, b) : 0 )) & globalmask;
 }
 
 uint64_t ror(uint64_t a, uint64_t b) {
 
     // prevent shift by 64 bits because a shift longer than type length is undefined behaviour
-    return shr(a, b) | (globalmasksize - a < 64 ? b << (globalmasksize - a) : 0);
+    return (shr(a, b) | (globalmasksize - a < 64 ? b << (globalmasksize - a) : 0)) & globalmask;
 }
 
 static uint64_t modulus(uint64_t a, uint64_t b) {
@@ -126,30 +416,176 @@ static uint64_t modulus(uint64_t a, uint64_t b) {
     if(!a)
         return 0;
 
-    return b % a;
+    return (b % a) & globalmask;
 }
 
 static uint64_t not(uint64_t a, uint64_t UNUSED(b)) {
 
-    return ~a;
+    return ~a & globalmask;
 }
 
 static uint64_t twos_complement(uint64_t a, uint64_t UNUSED(b)) {
 
-    return -a;
+    return -a & globalmask;
 }
 
 static uint64_t swap_endianness(uint64_t a, uint64_t UNUSED(b)) {
 
+    // Less than a byte has nothing to swap
+    if (globalmasksize < 8)
+        return a & globalmask;
+
+    // Swap all 8 bytes and bring the ones of the number down, the middle byte of an odd number of bytes
+    // stays in place, and the bits above the last whole byte are kept (like wide_swap_endianness())
+    return whole_units(__builtin_bswap64(a) >> (64 - globalmasksize / 8 * 8), a, globalmasksize, 8) & globalmask;
+}
+
+static uint64_t swap_endianness_8(uint64_t a, uint64_t UNUSED(b)) {
+
+    // A single byte stays the same
+    return (uint8_t) a;
+}
+
+static uint64_t swap_endianness_16(uint64_t a, uint64_t UNUSED(b)) {
+
+    return __builtin_bswap16(a);
+}
+
+static uint64_t swap_endianness_32(uint64_t a, uint64_t UNUSED(b)) {
+
+    return __builtin_bswap32(a);
+}
+
+static uint64_t swap_endianness_64(uint64_t a, uint64_t UNUSED(b)) {
+
+    return __builtin_bswap64(a);
+}
+
+static uint64_t swap_halfword_bytes(uint64_t a, uint64_t UNUSED(b)) {
+
+    return whole_units(halfword_bytes(a), a, globalmasksize, 16) & globalmask;
+}
+
+static uint64_t swap_word_bytes(uint64_t a, uint64_t UNUSED(b)) {
+
+    return whole_units(word_bytes(a), a, globalmasksize, 32) & globalmask;
+}
+
+static uint64_t swap_nibbles(uint64_t a, uint64_t UNUSED(b)) {
+
+    return whole_units(nibbles(a), a, globalmasksize, 8) & globalmask;
+}
+
+static uint64_t bit_reverse(uint64_t a, uint64_t UNUSED(b)) {
+
+    return reverse_bits(a & globalmask) >> (64 - globalmasksize);
+}
+
+/**
+ * @brief Swap the two bytes of every 16 bits
+ */
+static uint64_t halfword_bytes(uint64_t a) {
+
+    return (a & 0x00ff00ff00ff00ffull) << 8 | (a >> 8 & 0x00ff00ff00ff00ffull);
+}
+
+/**
+ * @brief Reverse the four bytes of every 32 bits
+ */
+static uint64_t word_bytes(uint64_t a) {
+
+    uint64_t swapped = __builtin_bswap64(a);
+    return swapped << 32 | swapped >> 32;
+}
+
+/**
+ * @brief Swap the two nibbles of every byte
+ */
+static uint64_t nibbles(uint64_t a) {
+
+    return (a & 0x0f0f0f0f0f0f0f0full) << 4 | (a >> 4 & 0x0f0f0f0f0f0f0f0full);
+}
+
+/**
+ * @brief Take the whole units of *unit* bits of the number from *swapped*, and the bits above them from *a*
+ *
+ * A number of bits that isn't a multiple of the unit leaves its last part of a unit as it was
+ */
+static uint64_t whole_units(uint64_t swapped, uint64_t a, int bits, int unit) {
+
+    int swapped_bits = bits / unit * unit;
+    uint64_t mask = swapped_bits >= 64 ? ~0ull : (1ull << swapped_bits) - 1;
+
+    return (swapped & mask) | (a & ~mask);
+}
+
+/**
+ * @brief Reverse the 64 bits: the bits of every byte and then the bytes
+ */
+static uint64_t reverse_bits(uint64_t a) {
+
+    a = (a & 0x5555555555555555ull) << 1 | (a >> 1 & 0x5555555555555555ull);
+    a = (a & 0x3333333333333333ull) << 2 | (a >> 2 & 0x3333333333333333ull);
+    a = (a & 0x0f0f0f0f0f0f0f0full) << 4 | (a >> 4 & 0x0f0f0f0f0f0f0f0full);
+
+    return __builtin_bswap64(a);
+}
+
+/**
+ * @brief Extract the bits of *value* under *mask* to the low bits, a byte of the mask at a time
+ */
+static uint64_t extract_bits(uint64_t value, uint64_t mask) {
+
+    pthread_once(&byte_tables_once, init_byte_tables);
+
     uint64_t out = 0;
-    // shift the leftmost bits to the right
-    for (int i = 0; i < globalmasksize / 16; i++) {
-        //        create a bitmask and apply it to a        and shift the selected byte to its new position
-        out |= (a & (0xffull << (globalmasksize-8 - i*8)) ) >> (globalmasksize-8 - i*16);
+    int shift = 0;
+
+    for (; mask; mask >>= 8, value >>= 8) {
+        uint8_t m = mask;
+        out |= (uint64_t) extract_table[m][(uint8_t) value] << shift;
+        shift += byte_bits[m];
     }
-    // shift the rightmost bits left (and leave the miidle bit in place in the case of an odd number of bytes)
-    for (int i = 0; i < globalmasksize / 16 + 1; i++) {
-        out |= (a & (0xffull << (((globalmasksize/2 - 1) & -8) - i*8)) ) << (((globalmasksize/8 & 1) ? 0 : 8) + i*16);
+
+    return out;
+}
+
+/**
+ * @brief Deposit the low bits of *value* in the bits of *mask*, a byte of the mask at a time
+ */
+static uint64_t deposit_bits(uint64_t value, uint64_t mask) {
+
+    pthread_once(&byte_tables_once, init_byte_tables);
+
+    uint64_t out = 0;
+
+    for (int shift = 0; mask; mask >>= 8, shift += 8) {
+        uint8_t m = mask;
+        out |= (uint64_t) deposit_table[m][(uint8_t) value] << shift;
+        value >>= byte_bits[m];
     }
+
     return out;
 }
+
+/**
+ * @brief Fill in the tables of extract_bits() and deposit_bits()
+ */
+static void init_byte_tables() {
+
+    for (int m = 0; m < 256; m++) {
+
+        byte_bits[m] = __builtin_popcount(m);
+
+        for (int v = 0; v < 256; v++) {
+            int k = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (!(m >> bit & 1))
+                    continue;
+                extract_table[m][v] |= (v >> bit & 1) << k;
+                deposit_table[m][v] |= (v >> k & 1) << bit;
+                k++;
+            }
+        }
+    }
+}
@@ -0,0 +1,187 @@
+#include <stdint.h>
+
+#include "operators.h"
+#include "optimizer.h"
+#include "parser.h"
+
+/*
+ * Optimization pass over expression trees
+ *
+ * Every rewrite keeps the value of the expression exactly the same at the current globalmasksize,
+ * so a tree optimized at one number of bits must not be calculated at another one.
+ *
+ * Nodes are rewritten in place, so the optimizer never allocates.
+ */
+
+static int is_constant(exprtree);
+static uint64_t constant_value(exprtree);
+static int equal_exprtrees(exprtree, exprtree);
+static int log2_of_power_of_two(uint64_t);
+static exprtree make_constant(exprtree, uint64_t);
+
+
+/**
+ * @brief Simplify an expression tree, returns the new root
+ *
+ * - unary operators lose the dummy zero operand the parser gives them (they become true unary nodes)
+ * - subtrees without variable parts are folded into constants
+ * - algebraic identities are applied (x&0, x|0, x^x, ~~x, ...)
+ * - multiplication, division and modulo by a power of two become shifts and masks
+ */
+exprtree optimize_exprtree(exprtree expr) {
+
+    if (expr->type != OP_TYPE)
+        return expr;
+
+    if (expr->left)
+        expr->left = optimize_exprtree(expr->left);
+    expr->right = optimize_exprtree(expr->right);
+
+    char symbol = expr->op->character;
+
+    // Unary operators only use the right operand, and 0-x is the same as the two's complement of x
+    if (expr->op->noperands == 1)
+        expr->left = NULL;
+
+    else if (symbol == SUB_SYMBOL && is_constant(expr->left) && constant_value(expr->left) == 0) {
+
+        expr->op = getopcode(TWOSCOMPLEMENT_SYMBOL);
+        expr->left = NULL;
+        symbol = TWOSCOMPLEMENT_SYMBOL;
+    }
+
+    // Constant folding
+    if ((expr->left == NULL || is_constant(expr->left)) && is_constant(expr->right))
+        return make_constant(expr, calculate(expr));
+
+    // Double negation: ~~x = x (the value of x is already masked)
+    if (symbol == NOT_SYMBOL && expr->right->type == OP_TYPE && expr->right->op->character == NOT_SYMBOL)
+        return expr->right->right;
+
+    if (expr->left == NULL)
+        return expr;
+
+    // Commutative operators with a constant on the left get it on the right, to simplify the rules below
+    if (is_constant(expr->left) && (symbol == ADD_SYMBOL || symbol == MUL_SYMBOL || symbol == AND_SYMBOL
+                || symbol == OR_SYMBOL || symbol == XOR_SYMBOL)) {
+
+        exprtree aux = expr->left;
+        expr->left = expr->right;
+        expr->right = aux;
+    }
+
+    exprtree x = expr->left;
+
+    if (symbol == XOR_SYMBOL && equal_exprtrees(x, expr->right))
+        return make_constant(expr, 0);
+
+    if (!is_constant(expr->right))
+        return expr;
+
+    uint64_t c = constant_value(expr->right);
+    int k = log2_of_power_of_two(c);
+
+    switch (symbol) {
+
+        case AND_SYMBOL:
+            if (c == 0)
+                return make_constant(expr, 0);
+            if (c == globalmask)
+                return x;
+            break;
+
+        case MUL_SYMBOL:
+            if (c == 0)
+                return make_constant(expr, 0);
+            if (c == 1)
+                return x;
+            if (k > 0) {
+                // x * 2^k = x << k
+                expr->op = getopcode(SHL_SYMBOL);
+                expr->right = make_constant(expr->right, k);
+            }
+            break;
+
+        case DIV_SYMBOL:
+            if (c == 1)
+                return x;
+            if (k > 0) {
+                // x / 2^k = x >> k (all values are unsigned)
+                expr->op = getopcode(SHR_SYMBOL);
+                expr->right = make_constant(expr->right, k);
+            }
+            break;
+
+        case MOD_SYMBOL:
+            if (k >= 0) {
+                // x % 2^k = x & (2^k - 1)
+                if (c == 1)
+                    return make_constant(expr, 0);
+                expr->op = getopcode(AND_SYMBOL);
+                expr->right = make_constant(expr->right, c - 1);
+            }
+            break;
+
+        case OR_SYMBOL:
+        case XOR_SYMBOL:
+        case ADD_SYMBOL:
+        case SUB_SYMBOL:
+        case SHL_SYMBOL:
+        case SHR_SYMBOL:
+            if (c == 0)
+                return x;
+            break;
+    }
+
+    return expr;
+}
+
+static int is_constant(exprtree expr) {
+
+    return expr->type != OP_TYPE && expr->type != VAR_TYPE;
+}
+
+/**
+ * @brief The value a constant has when calculated (masked to the current number of bits)
+ */
+static uint64_t constant_value(exprtree expr) {
+
+    return expr->value & globalmask;
+}
+
+static int equal_exprtrees(exprtree a, exprtree b) {
+
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    if (is_constant(a) || is_constant(b))
+        return is_constant(a) && is_constant(b) && constant_value(a) == constant_value(b);
+
+    if (a->type == VAR_TYPE || b->type == VAR_TYPE)
+        return a->type == b->type;
+
+    return a->op == b->op && equal_exprtrees(a->left, b->left) && equal_exprtrees(a->right, b->right);
+}
+
+/**
+ * @brief Returns k if n == 2^k, or -1 if n isn't a power of two
+ */
+static int log2_of_power_of_two(uint64_t n) {
+
+    if (n == 0 || (n & (n - 1)))
+        return -1;
+
+    return __builtin_ctzll(n);
+}
+
+/**
+ * @brief Turn the node into a constant leaf with the given value
+ */
+static exprtree make_constant(exprtree expr, uint64_t value) {
+
+    expr->type = DEC_TYPE;
+    expr->value = value;
+    expr->left = NULL;
+    expr->right = NULL;
+    return expr;
+}
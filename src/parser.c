@@ -4,32 +4,33 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lexer.h"
 #include "parser.h"
+#include "wide.h"
 #include "xmalloc.h"
 
 // Static functions
 
 static exprtree parse_expr(parser_t);
-static exprtree parse_or_expr(parser_t);
-static exprtree parse_xor_expr(parser_t);
-static exprtree parse_and_expr(parser_t);
-static exprtree parse_shift_expr(parser_t);
-static exprtree parse_add_expr(parser_t);
-static exprtree parse_mult_expr(parser_t);
+static exprtree parse_binary_expr(parser_t, int);
 static exprtree parse_prefix_expr(parser_t);
 static exprtree parse_atom_expr(parser_t);
 static exprtree parse_number(parser_t);
 
-static exprtree parse_stdop_expr(parser_t, char*, exprtree (*) (parser_t));
-
 static exprtree create_exprtree(int, void*, exprtree, exprtree);
 
-int total_trees_created = 0;
-int total_trees_freed = 0;
-int total_parsers_created = 0;
-int total_parsers_freed = 0;
-int total_tokens_created = 0;
-int total_tokens_freed = 0;
+// Tokens, parsers and expression trees of the current evaluation are all allocated here
+_Thread_local arena eval_arena = { NULL, NULL };
+
+// Value of the variable in map mode
+_Thread_local uint64_t variable_value = 0;
+
+_Thread_local int total_trees_created = 0;
+_Thread_local int total_trees_freed = 0;
+_Thread_local int total_parsers_created = 0;
+_Thread_local int total_parsers_freed = 0;
+_Thread_local int total_tokens_created = 0;
+_Thread_local int total_tokens_freed = 0;
 
 
 // For a simpler version of this parser check github.com/alt-romes/calculator-c-parser
@@ -37,51 +38,77 @@ int total_tokens_freed = 0;
 /**
  * @brief Sanitize input to only allowed characters
  *
- * Mallocs a new string with only allowed characters
+ * Allocates a new string with only allowed characters from the evaluation arena
  */
-char* sanitize(const char* in) {
-
-    char* output = xmalloc(sizeof(char) * MAX_CHARS);
+char* sanitize(const char* in, size_t in_len) {
 
-    int in_len = strlen(in);
-    int token_pos = 0;
-    for (int i = 0; i < in_len; i++)
-        if (strchr(VALID_TOKENS, in[i]))
-            output[token_pos++] = in[i];
+    // Map expressions and lines read with --file can be longer than the prompt
+    char* output = arena_alloc(&eval_arena, sizeof(char) * ((in_len > MAX_CHARS ? in_len : MAX_CHARS) + 1));
 
-    output[token_pos] = '\0';
+    output[sanitize_into(output, in, in_len)] = '\0';
 
     total_tokens_created++;
     return output;
 }
 
+/**
+ * @brief The sanitized *input* with the keywords of its operations written out, to show it
+ *
+ * Returns *input* itself when it has no keywords, otherwise a string from the evaluation arena
+ */
+const char* expand_keywords(const char* input) {
+
+    size_t len = 0, nkeywords = 0;
+    for (; input[len] != '\0'; len++)
+        if (char_class[(unsigned char) input[len]] & CHAR_NAMED)
+            nkeywords++;
+
+    if (nkeywords == 0)
+        return input;
+
+    char* output = arena_alloc(&eval_arena, len + nkeywords * (MAX_KEYWORD_LEN - 1) + 1);
+
+    int pos = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (getopcode(input[i]))
+            pos += format_operation(output + pos, getopcode(input[i]));
+        else
+            output[pos++] = input[i];
+    }
+
+    output[pos] = '\0';
+
+    return output;
+}
+
 
 /**
  * @brief Parse sanitized input into an expression tree
  *
- * Entry point to the parser. Frees input after parsing.
+ * Entry point to the parser. The input is no longer needed after parsing.
  */
 exprtree parse(char* input) {
 
     // TODO: How to stop with errors?
 
     // attention: allocate size for *struct parser_t*, because *parser_t* is type defined as a pointer to *struct parser_t*
-    parser_t parser = xmalloc(sizeof(struct parser_t));
+    parser_t parser = arena_alloc(&eval_arena, sizeof(struct parser_t));
     total_parsers_created++;
 
     assert(input != NULL);
-    parser->tokens = input;
 
-    int ntokens = strlen(input);
-    assert(ntokens > 0);
-    parser->ntokens = ntokens;
+    int len = strlen(input);
+    assert(len > 0);
+
+    // Lex the whole input once, the parser only looks at the tokens
+    parser->tokens = arena_alloc(&eval_arena, (len + 1) * sizeof(token));
+    parser->ntokens = lex(input, len, parser->tokens);
 
     parser->pos = 0;
 
     exprtree expression = parse_expr(parser);
 
-    free(parser->tokens);
-    free(parser);
+    // The parser and the tokens stay in the arena until the expression is freed
     total_parsers_freed++;
 
     total_tokens_freed++;
@@ -95,57 +122,80 @@ uint64_t calculate(exprtree expr) {
 
     // expr shouldn't be null if being calculated.
     assert(expr != NULL);
-    // all expressions have 2 operands because 1 operand operators are taken care of immediately
+    // the parser gives 1 operand operators a zero left operand, but after optimize_exprtree() they have no left operand
 
     if (expr->type == OP_TYPE) {
 
-        uint64_t left_value = calculate(expr->left);
+        uint64_t left_value = expr->left ? calculate(expr->left) : 0;
 
         uint64_t right_value = calculate(expr->right);
 
         // Execute takes the operands switched because the stack inverts the order of the numbers
-        uint64_t value = expr->op->execute(right_value, left_value);
-
-        return value & globalmask;
+        // The kernels of the current number of bits give results that are already masked
+        return expr->op->execute[active_kernels](right_value, left_value);
 
     }
     else {
 
-        // Expression is a leaf (is a number) - so return the number directly
+        // Expression is a leaf (is a number or the variable) - so return its value directly
+
+        if (expr->type == VAR_TYPE)
+            return variable_value & globalmask;
 
-        return *(expr->value) & globalmask;
+        return expr->value & globalmask;
     }
 
 }
 
 /**
- * @brief Free an expression tree and all its children
+ * @brief Calculate the value of an expression tree with more than 64 bits into *result*
+ *
+ * The values of the subtrees are kept in the evaluation arena until the tree is freed
  */
-void free_exprtree(exprtree expr) {
+void calculate_wide(exprtree expr, wide* result) {
 
-    if (expr) {
+    assert(expr != NULL);
 
-        if (expr->left)
-            free_exprtree(expr->left);
-        if (expr->right)
-            free_exprtree(expr->right);
+    if (expr->type == OP_TYPE) {
 
+        wide* left_value = arena_alloc(&eval_arena, sizeof(wide));
+        if (expr->left)
+            calculate_wide(expr->left, left_value);
+        else
+            wide_from_u64(left_value, 0);
 
-        if (expr->type != OP_TYPE)
-            free(expr->value);
+        calculate_wide(expr->right, result);
 
-        free(expr);
+        // Operands switched like in calculate()
+        expr->op->wide_execute(result, result, left_value);
+    }
+    else if (expr->type == WIDE_TYPE)
+        wide_copy(result, expr->wide_value);
+    else if (expr->type == VAR_TYPE)
+        wide_from_u64(result, variable_value);
+    else
+        wide_from_u64(result, expr->value);
+
+    wide_mask(result);
+}
 
-        total_trees_freed++;
+/**
+ * @brief Free an expression tree and all its children
+ *
+ * Everything allocated during the evaluation (tokens, parser and all the nodes of the tree)
+ * lives in the evaluation arena, so it is all released at once by resetting the arena
+ */
+void free_exprtree(exprtree UNUSED(expr)) {
 
-    }
+    arena_reset(&eval_arena);
 
+    total_trees_freed = total_trees_created;
 }
 
 /**
  * @brief Parse sub-string in parser into expression tree
  *
- * Works by recursively calling different parse functions until all tokens gets consumed.
+ * Works by precedence climbing: the precedence and associativity of each operator come from the operations table.
  * Sarts with lowest precedence.
  * Inner recursive calls, which get executed first, are higher precedence.
  */
@@ -153,72 +203,48 @@ static exprtree parse_expr(parser_t parser) {
 
     // Grammar rule: expression := or_exp
 
-    return parse_or_expr(parser);
-}
-
-static exprtree parse_or_expr(parser_t parser) {
-
-    // Grammar rule: or_exp := xor_exp ( (| | $) xor_exp )*
-
-    char ops[] = {OR_SYMBOL, NOR_SYMBOL, '\0'};
-
-    return parse_stdop_expr(parser, ops, parse_xor_expr);
-
-}
-
-static exprtree parse_xor_expr(parser_t parser) {
-
-    // Grammar rule: xor_exp := and_exp (^ and_exp)*
-
-    char ops[] = {XOR_SYMBOL, '\0'};
-
-    return parse_stdop_expr(parser, ops, parse_and_expr);
-
-}
-
-static exprtree parse_and_expr(parser_t parser) {
-
-    // Grammar rule: and_exp := shift_exp (& shift_exp)*
-
-    char ops[] = {AND_SYMBOL, '\0'};
-
-    return parse_stdop_expr(parser, ops, parse_shift_expr);
-
-}
-
-static exprtree parse_shift_expr(parser_t parser) {
-
-    // Grammar rule: shift_exp := add_exp ((<< | >> | ror | rol) add_exp)*
-
-    char ops[] = {SHR_SYMBOL, SHL_SYMBOL, ROR_SYMBOL, ROL_SYMBOL, '\0'};
-
-    return parse_stdop_expr(parser, ops, parse_add_expr);
-
+    return parse_binary_expr(parser, PREC_NONE + 1);
 }
 
-static exprtree parse_add_expr(parser_t parser) {
+/**
+ * @brief Tries to parse next binary expression with operators of at least *min_precedence*
+ *
+ * First parses the left side of the operation as a prefix expression.
+ * Then, while the next token is an operator that binds at least as tight as min_precedence,
+ * parses the right side of the operation with the operators that bind tighter than it (or as tight, if right associative).
+ * If no such operator is found, this means that parsing of the current sub-string is done.
+ */
+static exprtree parse_binary_expr(parser_t parser, int min_precedence) {
 
-    // Grammar rule: add_exp := mult_exp ((+ | -) mult_exp)*
+    // TODO: We don't want to do this - when the input is badly formatted an error should be displayed.
+    // This is a temporary fix that returns the expression immediately as zero.
+    if (!(parser->pos < parser->ntokens)) {
 
-    char ops[] = {ADD_SYMBOL, SUB_SYMBOL, '\0'};
+        uint64_t zerov = 0;
+        return create_exprtree(DEC_TYPE, &zerov, NULL, NULL);
+    }
 
-    return parse_stdop_expr(parser, ops, parse_mult_expr);
+    exprtree expr = parse_prefix_expr(parser);
 
-}
+    operation* op;
+    while (parser->tokens[parser->pos].type == TOK_OPERATOR && (op = parser->tokens[parser->pos].op)->precedence != PREC_NONE
+            && op->precedence >= min_precedence) {
 
-static exprtree parse_mult_expr(parser_t parser) {
+        parser->pos++; // Consume token
 
-    // Grammar rule: mult_exp := not_exp ((* | / | %) not_exp)*
+        int right_precedence = op->associativity == ASSOC_LEFT ? op->precedence + 1 : op->precedence;
+        exprtree right_expr = parse_binary_expr(parser, right_precedence);
 
-    char ops[] = {MUL_SYMBOL, DIV_SYMBOL, MOD_SYMBOL, '\0'};
+        expr = create_exprtree(OP_TYPE, op, expr, right_expr);
+    }
 
-    return parse_stdop_expr(parser, ops, parse_prefix_expr);
+    return expr;
 
 }
 
 static exprtree parse_prefix_expr(parser_t parser) {
 
-    // Grammar rule: prefix_exp := (~ | + | - | @)? atom_exp
+    // Grammar rule: prefix_exp := (+ | - | operator with one operand)? atom_exp
 
     // TODO: Display input invalid instead of using a zero-val expression
     if (!(parser->pos < parser->ntokens)) {
@@ -228,19 +254,18 @@ static exprtree parse_prefix_expr(parser_t parser) {
     }
 
 
-    char prefixes[] = {ADD_SYMBOL, SUB_SYMBOL, NOT_SYMBOL, TWOSCOMPLEMENT_SYMBOL, SWAPENDIANNESS_SYMBOL, '\0'};
-
     // If we've exceeded the number of tokens we should detect an error
     assert(parser->pos < parser->ntokens);
 
     char prefix = 0;
-    if (strchr(prefixes, parser->tokens[parser->pos])) {
+    token* t = &parser->tokens[parser->pos];
+    if (t->type == TOK_OPERATOR && t->op->prefix) {
 
         // Find + or - before the number (to make numbers positive or negative)
 
         // When the symbol found is +, there's no need to do anything
 
-        prefix = parser->tokens[parser->pos];
+        prefix = t->op->character;
 
         parser->pos++; // Consume token
     }
@@ -251,7 +276,7 @@ static exprtree parse_prefix_expr(parser_t parser) {
         return expr;
     else {
 
-        // Prefix is either SUB_SYMBOL, NOT_SYMBOL, TWOSCOMPLEMENT_SYMBOL or SWAPENDIANNESS_SYMBOL
+        // Prefix is SUB_SYMBOL or an operation with one operand (i.e. NOT_SYMBOL)
 
         // We get the operation to use in the expression
         operation* op = getopcode(prefix);
@@ -278,7 +303,7 @@ static exprtree parse_prefix_expr(parser_t parser) {
  */
 static exprtree parse_atom_expr(parser_t parser) {
 
-    // Grammar rule: atom_expr := number | left_parenthesis expression right_parenthesis
+    // Grammar rule: atom_expr := number | variable | left_parenthesis expression right_parenthesis
 
     // TODO: An error should be displayed here instead of return a zero value expression.
     // This assertion fails if the only token is a prefix, the prefix is read, and this function is called without enough tokens
@@ -294,7 +319,7 @@ static exprtree parse_atom_expr(parser_t parser) {
 
     exprtree expr;
 
-    if (parser->tokens[parser->pos] == LPAR_SYMBOL) {
+    if (parser->tokens[parser->pos].type == TOK_LPAR) {
         // If the atomic expression starts with parenthesis
 
         parser->pos++; // Consume left parenthesis
@@ -306,7 +331,7 @@ static exprtree parse_atom_expr(parser_t parser) {
         // It should be handled as an error below
         /* assert(parser->pos < parser->ntokens); */
 
-        if (parser->tokens[parser->pos] == RPAR_SYMBOL)
+        if (parser->tokens[parser->pos].type == TOK_RPAR)
             parser->pos++; // Consume right parenthesis
         else {
 
@@ -334,124 +359,41 @@ static exprtree parse_atom_expr(parser_t parser) {
  */
 static exprtree parse_number(parser_t parser) {
 
-    // Grammar rule: number: ( (0-9)+ | 0?x(0-9a-f)+ | 0?b(0-1)+ )
+    // Grammar rule: number: ( (0-9)+ | 0?x(0-9a-f)+ | 0?b(0-1)+ ) | variable
 
     // If we've exceeded the number of tokens we should detect an error
     assert(parser->pos < parser->ntokens);
 
-    int numbertype = DEC_TYPE;
-    if (parser->pos+1 < parser->ntokens) {
-        switch (parser->tokens[parser->pos]) {
-            case '0':
-                // check second character
-                switch(parser->tokens[parser->pos+1]) {
-                    case 'b': // 0b0101
-                        numbertype = BIN_TYPE;
-                        parser->pos += 2;
-                        break;
-                    case 'x': // 0xffff
-                        numbertype = HEX_TYPE;
-                        parser->pos += 2;
-                        break;
-                    default:  // number is decimal
-                        break;
-                }
-                break;
-            case 'x': // xffff
-                numbertype = HEX_TYPE;
-                parser->pos += 1;
-                break;
-            case 'b': // b0101
-                numbertype = BIN_TYPE;
-                parser->pos += 1;
-                break;
-        }
-
-    }
-
-    char numberfound[MAX_CHARS + 1];
-    int numberlen = 0;
-
-    while ( parser->pos < parser->ntokens &&
-            ((numbertype == DEC_TYPE && strchr(VALID_DEC_SYMBOLS, parser->tokens[parser->pos]))
-            || (numbertype == HEX_TYPE && strchr(VALID_HEX_SYMBOLS, parser->tokens[parser->pos]))
-            || (numbertype == BIN_TYPE && strchr(VALID_BIN_SYMBOLS, parser->tokens[parser->pos]))) ) {
-
-        numberfound[numberlen++] = parser->tokens[parser->pos];
-
-        parser->pos++; // Consume 1 digit (1 token)
-
-    }
-    numberfound[numberlen] = '\0';
+    token* t = &parser->tokens[parser->pos];
 
     // If no number was found, return for now a zero value expression
     //
     // TODO: return the error expression instead
-    // this happens when the input is valid tokens like abc, but then the number doesn't start with 0x,
-    // and possibly in other situations
-    if (numberlen == 0) {
+    // this happens when an operator that can't be a prefix is found where a number was expected
+    if (t->type == TOK_VARIABLE) {
 
-        uint64_t zerov = 0;
-        return create_exprtree(DEC_TYPE, &zerov, NULL, NULL);
-    }
+        parser->pos++;
 
-    // Else, create the expression from the found number
-    int numberbase = 0;
-    switch (numbertype) {
-        case DEC_TYPE:
-            numberbase = 10;
-            break;
-        case HEX_TYPE:
-            numberbase = 16;
-            break;
-        case BIN_TYPE:
-            numberbase = 2;
-            break;
+        uint64_t zerov = 0;
+        return create_exprtree(VAR_TYPE, &zerov, NULL, NULL);
     }
 
-    uint64_t value = strtoull(numberfound, NULL, numberbase);
+    if (t->type == TOK_WIDE_NUMBER) {
 
-    exprtree number_expr = create_exprtree(numbertype, &value, NULL, NULL);
-
-    return number_expr;
-}
+        parser->pos++;
 
-/**
- * @brief Tries to parse next binary expression with any of chars in ops as operator
- *
- * First tries to parse left side of operation with parse_inner_expr.
- * This means that parse_inner_expr gets a higher priority in operator precedence.
- * Then looks for any of the chars in ops, if found, tries to parse right side of operation with parse_inner_expr.
- * If the operator was not found, this means that parsing of the current sub-string is done.
- */
-static exprtree parse_stdop_expr(parser_t parser, char* ops, exprtree (*parse_inner_expr) (parser_t)) {
+        return create_exprtree(WIDE_TYPE, (void*) t->wide_value, NULL, NULL);
+    }
 
-    // TODO: We don't want to do this - when the input is badly formatted an error should be displayed.
-    // This is a temporary fix that returns the expression immediately as zero.
-    if (!(parser->pos < parser->ntokens)) {
+    if (t->type != TOK_NUMBER) {
 
         uint64_t zerov = 0;
         return create_exprtree(DEC_TYPE, &zerov, NULL, NULL);
     }
 
-    // When the position gets here it should be smaller than the ntokens, or maybe only inner_expr should worry about it?
-    assert(parser->pos < parser->ntokens);
-
-    exprtree expr = parse_inner_expr(parser);
-
-    while (parser->pos < parser->ntokens && strchr(ops, parser->tokens[parser->pos])) {
-
-        operation* op = getopcode(parser->tokens[parser->pos]);
-
-        parser->pos++; // Consume token
-
-        exprtree right_expr = parse_inner_expr(parser);
-
-        expr = create_exprtree(OP_TYPE, op, expr, right_expr);
-    }
-
-    return expr;
+    parser->pos++; // Consume the number (decoded by the lexer)
 
+    return create_exprtree(t->numbertype, &t->value, NULL, NULL);
 }
 
 /**
@@ -460,19 +402,16 @@ static exprtree parse_stdop_expr(parser_t parser, char* ops, exprtree (*parse_in
 static exprtree create_exprtree(int type, void* content, exprtree left, exprtree right) {
 
     // attention: allocate size for *struct exprtree*, because *exprtree* is type defined as a pointer to *struct exprtree*
-    exprtree expr = xmalloc(sizeof(struct exprtree));
+    exprtree expr = arena_alloc(&eval_arena, sizeof(struct exprtree));
 
     expr->type = type;
 
     if (type == OP_TYPE)
         expr->op = getopcode(*((char*) content));
-
-    else {
-
-        void* allocated[] = { expr };
-        expr->value = xmalloc_with_ressources(sizeof(*expr->value), allocated, 1);
-        *(expr->value) = *((uint64_t*) content);
-    }
+    else if (type == WIDE_TYPE)
+        expr->wide_value = content; // Wide numbers stay in the arena, where the lexer put them
+    else
+        expr->value = *((uint64_t*) content); // Leaf values are stored inline in the node
 
     expr->left = left;
     expr->right = right;
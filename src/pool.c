@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "global.h"
+#include "pool.h"
+#include "xmalloc.h"
+
+/*
+ * Work stealing thread pool
+ *
+ * Every worker has its own deque of tasks, and tasks are submitted to the deques in turn.
+ * A worker takes tasks from the front of its own deque, and when that is empty it steals from
+ * the back of the other deques, so a worker that got slow tasks doesn't hold back the others.
+ * Deques have their own lock, so workers only contend when they touch the same deque
+ */
+
+typedef struct worker_arg {
+    work_pool* pool;
+    int id;
+} worker_arg;
+
+static void* worker_main(void*);
+static void* take_task(work_pool*, int);
+static void* pop_front(pool_deque*);
+static void* pop_back(pool_deque*);
+
+
+/**
+ * @brief Start *nworkers* threads that call *run* for every submitted task
+ *
+ * *done* (can be NULL) is called by every worker thread before it exits, to release what it used
+ */
+work_pool* create_pool(int nworkers, void (*run)(void*), void (*done)()) {
+
+    if (nworkers > POOL_MAX_WORKERS)
+        nworkers = POOL_MAX_WORKERS;
+
+    work_pool* pool = xmalloc(sizeof(work_pool));
+
+    pool->nworkers = nworkers;
+    pool->threads = xmalloc(nworkers * sizeof(pthread_t));
+    pool->args = xmalloc(nworkers * sizeof(worker_arg));
+    pool->deques = xmalloc(nworkers * sizeof(pool_deque));
+    pool->next_deque = 0;
+    pool->run = run;
+    pool->done = done;
+    atomic_init(&pool->pending, 0);
+    pool->shutdown = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+
+    for (int i = 0; i < nworkers; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].front = pool->deques[i].back = 0;
+    }
+
+    for (int i = 0; i < nworkers; i++) {
+
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]) != 0)
+            exit_pcalc(MEM_FAIL);
+    }
+
+    return pool;
+}
+
+/**
+ * @brief Queue a task, returns 0 if all the deques are full
+ */
+int submit_task(work_pool* pool, void* task) {
+
+    for (int i = 0; i < pool->nworkers; i++) {
+
+        pool_deque* d = &pool->deques[pool->next_deque++ % pool->nworkers];
+
+        pthread_mutex_lock(&d->lock);
+
+        if (d->back - d->front == POOL_DEQUE_SIZE) {
+            pthread_mutex_unlock(&d->lock);
+            continue;
+        }
+
+        d->tasks[d->back++ % POOL_DEQUE_SIZE] = task;
+        pthread_mutex_unlock(&d->lock);
+
+        // Counted under the pool lock, so a worker can't miss it between checking and going to sleep
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->pending, 1);
+        pthread_cond_signal(&pool->wakeup);
+        pthread_mutex_unlock(&pool->lock);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Wait until all the submitted tasks are run, then stop the workers and free the pool
+ */
+void destroy_pool(work_pool* pool) {
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nworkers; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (int i = 0; i < pool->nworkers; i++)
+        pthread_mutex_destroy(&pool->deques[i].lock);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wakeup);
+
+    xfree(pool->deques);
+    xfree(pool->args);
+    xfree(pool->threads);
+    xfree(pool);
+}
+
+static void* worker_main(void* arg) {
+
+    work_pool* pool = ((worker_arg*) arg)->pool;
+    int id = ((worker_arg*) arg)->id;
+
+    for (;;) {
+
+        void* task = take_task(pool, id);
+        if (task != NULL) {
+            pool->run(task);
+            continue;
+        }
+
+        // Nothing to take: sleep until a task is submitted, or exit when the pool is shut down and empty
+        pthread_mutex_lock(&pool->lock);
+
+        while (atomic_load(&pool->pending) == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+
+        int finished = atomic_load(&pool->pending) == 0 && pool->shutdown;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (finished)
+            break;
+    }
+
+    if (pool->done != NULL)
+        pool->done();
+
+    return NULL;
+}
+
+/**
+ * @brief Next task for worker *id*: from its own deque first, then stolen from the others
+ */
+static void* take_task(work_pool* pool, int id) {
+
+    void* task = pop_front(&pool->deques[id]);
+
+    for (int i = 1; task == NULL && i < pool->nworkers; i++)
+        task = pop_back(&pool->deques[(id + i) % pool->nworkers]);
+
+    if (task != NULL)
+        atomic_fetch_sub(&pool->pending, 1);
+
+    return task;
+}
+
+static void* pop_front(pool_deque* d) {
+
+    void* task = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->front != d->back)
+        task = d->tasks[d->front++ % POOL_DEQUE_SIZE];
+    pthread_mutex_unlock(&d->lock);
+
+    return task;
+}
+
+static void* pop_back(pool_deque* d) {
+
+    void* task = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->front != d->back)
+        task = d->tasks[--d->back % POOL_DEQUE_SIZE];
+    pthread_mutex_unlock(&d->lock);
+
+    return task;
+}
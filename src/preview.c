@@ -0,0 +1,308 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "batch.h"
+#include "lexer.h"
+#include "numberstack.h"
+#include "operators.h"
+#include "parser.h"
+#include "preview.h"
+
+/*
+ * Live preview of the prompt while it's typed
+ *
+ * The expression is kept between keys with its tokens and the state of an operator precedence
+ * parser before each token. The parser calculates as it goes, and the nodes of its stack are never
+ * changed once pushed, so the state before a token is all that's needed to go on from there.
+ * When the expression changes, the tokens that end before the first changed character are kept,
+ * and only the rest is lexed and parsed again from the state before it.
+ *
+ * The parser gives the same values as parse() and calculate(), errors included:
+ * a missing operand is a zero, and parentheses that are never closed are a zero as a whole
+ */
+
+static char text[PREVIEW_MAX_LEN + 1];
+static int textlen = 0;
+
+static token tokens[PREVIEW_MAX_LEN + 1];
+static int token_end[PREVIEW_MAX_LEN];
+static int ntokens = 0;
+
+// The state before each token, and after the last one
+static preview_state states[PREVIEW_MAX_LEN + 1];
+static preview_node nodes[PREVIEW_MAX_NODES];
+
+// Values are masked, so they're only valid for the number of bits they were calculated with
+static int preview_masksize = 0;
+
+static void parse_token(preview_state*, const token*);
+static void push_node(preview_state*, int, uint64_t, operation*);
+static uint64_t reduce(preview_state*, int);
+static uint64_t finish(const preview_state*);
+static uint64_t apply_prefix(operation*, uint64_t);
+static void apply_operation(uint64_t*, int*, operation**);
+
+
+/**
+ * @brief Find the value process_prompt() would leave at the top of the stack for *prompt*
+ *
+ * Returns 0 when there's nothing to show: the prompt is empty, too long or a command,
+ * or the numbers have more than 64 bits
+ */
+int preview_prompt(const char* prompt, size_t len, uint64_t* value) {
+
+    if (len == 0 || len > PREVIEW_MAX_LEN || is_command_line(prompt, len) || globalmasksize > DEFAULT_MASK_SIZE)
+        return 0;
+
+    // Sanitized like sanitize() does, without the arena
+    char input[PREVIEW_MAX_LEN + 1];
+    int inputlen = sanitize_into(input, prompt, len);
+
+    // The op at the start and at the end are taken out of the expression the same way process_prompt() does
+    operation* op = current_op;
+    operation* suffix_op = NULL;
+    int start = 0;
+
+    if (inputlen > 0 && getopcode(input[0]) && (inputlen == 1 || getopcode(input[0])->noperands == 2)) {
+        op = getopcode(input[0]);
+        start = 1;
+    }
+
+    if (inputlen > start && getopcode(input[inputlen-1]))
+        suffix_op = getopcode(input[--inputlen]);
+
+    // The operations take at most two numbers, so the top two are all that's needed of the stack
+    uint64_t stack[3];
+    int size = 0;
+
+    if (op != NULL) {
+        for (int i = numbers->size < 2 ? numbers->size : 2; i > 0; i--)
+            stack[size++] = numbers->elements[numbers->size - i];
+    }
+
+    if (inputlen > start) {
+
+        stack[size++] = preview_expression(input + start, inputlen - start);
+
+        if (suffix_op != NULL) {
+            apply_operation(stack, &size, &op);
+            op = suffix_op;
+        }
+    }
+    else if (op == NULL)
+        stack[size++] = 0;
+
+    apply_operation(stack, &size, &op);
+
+    if (size == 0)
+        return 0;
+
+    *value = stack[size-1];
+    return 1;
+}
+
+/**
+ * @brief Calculate the sanitized *input*, going on from the longest prefix it shares with the last one
+ *
+ * *len* can be at most PREVIEW_MAX_LEN
+ */
+uint64_t preview_expression(const char* input, int len) {
+
+    int same = 0;
+    if (preview_masksize == globalmasksize)
+        while (same < len && same < textlen && input[same] == text[same])
+            same++;
+
+    preview_masksize = globalmasksize;
+
+    // Keep the tokens that end before the first change
+    int k = 0;
+    while (k < ntokens && token_end[k] < same)
+        k++;
+
+    memcpy(text + same, input + same, len - same);
+    textlen = len;
+
+    // Lex the rest again, stopping where the parser would
+    ntokens = k;
+    for (int pos = k ? token_end[k-1] : 0, end; pos < len; pos = end) {
+
+        end = lex_token(text, len, pos, &tokens[ntokens]);
+        if (end == pos)
+            break;
+
+        token_end[ntokens++] = end;
+    }
+    tokens[ntokens].type = TOK_END;
+
+    // Parse the new tokens from the state before them
+    states[0] = (preview_state) { .top = -1, .nnodes = 0, .mode = PREVIEW_OPERAND, .prefix = NULL, .depth = 0 };
+
+    for (int i = k; i < ntokens; i++) {
+        states[i+1] = states[i];
+        parse_token(&states[i+1], &tokens[i]);
+    }
+
+    return finish(&states[ntokens]);
+}
+
+/**
+ * @brief Move the parser past one token, calculating everything the token completes
+ *
+ * Follows parse_binary_expr(), parse_prefix_expr() and parse_atom_expr() in parser.c
+ */
+static void parse_token(preview_state* s, const token* t) {
+
+    if (s->mode == PREVIEW_DONE)
+        return;
+
+    if (s->mode == PREVIEW_OPERAND && t->type == TOK_OPERATOR && t->op->prefix) {
+        s->mode = PREVIEW_ATOM;
+        s->prefix = t->op;
+        return;
+    }
+
+    if (s->mode != PREVIEW_OPERATOR) {
+
+        operation* prefix = s->mode == PREVIEW_ATOM ? s->prefix : NULL;
+        s->mode = PREVIEW_OPERATOR;
+
+        if (t->type == TOK_LPAR) {
+            push_node(s, NODE_GROUP, 0, prefix);
+            s->depth++;
+            s->mode = PREVIEW_OPERAND;
+            return;
+        }
+
+        if (t->type == TOK_NUMBER) {
+            push_node(s, NODE_VALUE, apply_prefix(prefix, t->value & globalmask), NULL);
+            return;
+        }
+
+        if (t->type == TOK_VARIABLE) {
+            push_node(s, NODE_VALUE, apply_prefix(prefix, variable_value & globalmask), NULL);
+            return;
+        }
+
+        // Anything else where an operand should be is a zero, and the token is read again after it
+        push_node(s, NODE_VALUE, apply_prefix(prefix, 0), NULL);
+    }
+
+    if (t->type == TOK_OPERATOR && t->op->precedence != PREC_NONE) {
+
+        // The operators before it that bind at least as tight have all their operands now
+        push_node(s, NODE_VALUE, reduce(s, t->op->precedence), NULL);
+
+        push_node(s, NODE_OPERATOR, 0, t->op);
+        s->mode = PREVIEW_OPERAND;
+    }
+    else if (t->type == TOK_RPAR && s->depth > 0) {
+
+        // Everything since the left parenthesis, which is left at the top
+        uint64_t value = reduce(s, PREC_NONE);
+
+        value = apply_prefix(nodes[s->top].op, value);
+        s->top = nodes[s->top].next;
+        push_node(s, NODE_VALUE, value, NULL);
+        s->depth--;
+    }
+    else {
+        // The parser stops at anything else
+        s->mode = PREVIEW_DONE;
+    }
+}
+
+static void push_node(preview_state* s, int type, uint64_t value, operation* op) {
+
+    preview_node* node = &nodes[s->nnodes];
+
+    node->type = type;
+    if (type == NODE_VALUE)
+        node->value = value;
+    else
+        node->op = op;
+    node->next = s->top;
+
+    s->top = s->nnodes++;
+}
+
+/**
+ * @brief Pop the value at the top of the stack and calculate it with the operators before it that bind tighter than *precedence*
+ */
+static uint64_t reduce(preview_state* s, int precedence) {
+
+    uint64_t value = nodes[s->top].value;
+    int below = nodes[s->top].next;
+
+    while (below >= 0 && nodes[below].type == NODE_OPERATOR
+            && precedence < nodes[below].op->precedence + (nodes[below].op->associativity == ASSOC_LEFT)) {
+
+        int left = nodes[below].next;
+
+        // Execute takes the operands switched, like in calculate()
+        value = nodes[below].op->execute[active_kernels](value, nodes[left].value);
+
+        below = nodes[left].next;
+    }
+
+    s->top = below;
+    return value;
+}
+
+/**
+ * @brief The value of the expression when the tokens end in state *s*
+ */
+static uint64_t finish(const preview_state* s) {
+
+    uint64_t value;
+    int node = s->top;
+
+    if (s->mode == PREVIEW_OPERATOR || s->mode == PREVIEW_DONE) {
+        value = nodes[node].value;
+        node = nodes[node].next;
+    }
+    else
+        value = apply_prefix(s->mode == PREVIEW_ATOM ? s->prefix : NULL, 0);
+
+    while (node >= 0) {
+
+        if (nodes[node].type == NODE_OPERATOR) {
+
+            int left = nodes[node].next;
+            value = nodes[node].op->execute[active_kernels](value, nodes[left].value);
+            node = nodes[left].next;
+        }
+        else {
+
+            // Parentheses that aren't closed are a zero with everything in them
+            value = apply_prefix(nodes[node].op, 0);
+            node = nodes[node].next;
+        }
+    }
+
+    return value;
+}
+
+static uint64_t apply_prefix(operation* prefix, uint64_t value) {
+
+    if (prefix == NULL || prefix->character == ADD_SYMBOL)
+        return value;
+
+    return prefix->execute[active_kernels](value, 0);
+}
+
+/**
+ * @brief Same as apply_operations() in main.c, on the top of a copy of the stack
+ */
+static void apply_operation(uint64_t* stack, int* size, operation** op) {
+
+    if (*op == NULL || *size < (*op)->noperands)
+        return;
+
+    uint64_t operands[2] = {0};
+    for (unsigned char i = 0; i < (*op)->noperands; i++)
+        operands[i] = stack[--*size];
+
+    stack[(*size)++] = (*op)->execute[active_kernels](operands[0], operands[1]);
+    *op = NULL;
+}
@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "history.h"
+#include "search.h"
+#include "xmalloc.h"
+
+/*
+ * Persistent input history, and the index of its incremental search (Ctrl-R)
+ *
+ * Every input is appended to the history file as a line. At startup the file is mapped and
+ * only its newest lines are read, the ones that fit in the input history the arrows browse.
+ * The whole file is only split into records when it's searched for the first time.
+ *
+ * Records are numbered from the oldest line of the file to the newest input of this session.
+ * For every trigram the index keeps the records that contain it, oldest first, so a search only
+ * looks at the records that have all the trigrams of the query, from the newest one back.
+ * Queries shorter than a trigram are matched record by record, which stops at the first match,
+ * and doesn't start when no record has their characters
+ */
+
+typedef struct search_entry {
+    const char* text;       // Not null terminated in the file
+    int len;
+} search_entry;
+
+static int history_fd = -1;
+static const char* file_text = NULL;
+static size_t file_size = 0;
+static int file_ends_line = 1;
+
+// The lines of the file, -1 until it's split
+static search_entry* file_records = NULL;
+static int nfile_records = -1;
+
+static search_entry* session_records = NULL;
+static int nsession_records = 0;
+static int max_session_records = 0;
+
+// Hash table of the trigrams, and which characters and pairs of characters the records have
+static trigram_postings* buckets = NULL;
+static int nbuckets = 0;
+static int nused_buckets = 0;
+static unsigned char char_seen[256 / 8];
+static unsigned char pair_seen[65536 / 8];
+
+// Records in the index, from the oldest one
+static int nindexed = 0;
+
+static void load_newest_records();
+static void split_file();
+static void update_index();
+static void index_record(int, const char*, int);
+static trigram_postings* find_postings(uint32_t, int);
+static void grow_index();
+static int contains_id(const trigram_postings*, int);
+static uint32_t trigram_key(const char*);
+
+
+/**
+ * @brief Map the history file at *path* (created if it doesn't exist) and fill the input history with its newest lines
+ *
+ * Without the file, the history of this session is still searched
+ */
+void open_history_file(const char* path) {
+
+    history_fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0600);
+    if (history_fd < 0) {
+        fprintf(stderr, "pcalc: %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(history_fd, &st) < 0 || st.st_size == 0)
+        return;
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history_fd, 0);
+    if (map == MAP_FAILED)
+        return;
+
+    file_text = map;
+    file_size = st.st_size;
+    file_ends_line = file_text[file_size-1] == '\n';
+
+    load_newest_records();
+}
+
+/**
+ * @brief Add an input to the history file and to the records searched
+ */
+void append_history_file(const char* in) {
+
+    int len = strlen(in);
+    if (len == 0 || len > MAX_IN)
+        return;
+
+    if (nsession_records == max_session_records) {
+        max_session_records = max_session_records ? 2 * max_session_records : 64;
+        session_records = xrealloc(session_records, max_session_records * sizeof(search_entry));
+    }
+    session_records[nsession_records++] = (search_entry) { xstrdup(in), len };
+
+    if (history_fd < 0)
+        return;
+
+    // The line is written at once, so inputs of different processes don't mix
+    char line[MAX_IN + 2];
+    int n = 0;
+
+    if (!file_ends_line)
+        line[n++] = '\n';
+    memcpy(line + n, in, len);
+    n += len;
+    line[n++] = '\n';
+
+    if (write(history_fd, line, n) == n)
+        file_ends_line = 1;
+}
+
+/**
+ * @brief Find the newest record older than *before* that contains the *len* characters of *query*
+ *
+ * Returns its id, or -1 when there's none
+ */
+int search_history(const char* query, int len, int before) {
+
+    if (len <= 0)
+        return -1;
+
+    update_index();
+
+    if (before > nindexed)
+        before = nindexed;
+
+    if (len < 3) {
+
+        unsigned char c0 = query[0], c1 = query[len-1];
+        if (!(char_seen[c0 / 8] & 1 << c0 % 8) || !(char_seen[c1 / 8] & 1 << c1 % 8))
+            return -1;
+
+        int pair = c0 << 8 | c1;
+        if (len == 2 && !(pair_seen[pair / 8] & 1 << pair % 8))
+            return -1;
+
+        for (int id = before - 1; id >= 0; id--) {
+            int reclen;
+            const char* text = search_record(id, &reclen);
+            if (memmem(text, reclen, query, len) != NULL)
+                return id;
+        }
+
+        return -1;
+    }
+
+    // The postings of every trigram of the query, the shortest one gives the candidates
+    const trigram_postings* postings[MAX_IN];
+    int npostings = 0;
+    int shortest = 0;
+
+    for (int i = 0; i + 3 <= len; i++) {
+
+        const trigram_postings* p = find_postings(trigram_key(query + i), 0);
+        if (p == NULL)
+            return -1;
+
+        if (npostings == 0 || p->size < postings[shortest]->size)
+            shortest = npostings;
+        postings[npostings++] = p;
+    }
+
+    const trigram_postings* candidates = postings[shortest];
+
+    // Skip the candidates from *before* on
+    int lo = 0, hi = candidates->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (candidates->ids[mid] < before)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (int k = lo - 1; k >= 0; k--) {
+
+        int id = candidates->ids[k];
+
+        int all = 1;
+        for (int i = 0; i < npostings && all; i++)
+            all = i == shortest || contains_id(postings[i], id);
+
+        // Having the trigrams doesn't mean having them in the same order
+        int reclen;
+        const char* text = search_record(id, &reclen);
+        if (all && memmem(text, reclen, query, len) != NULL)
+            return id;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief The text of a record, which isn't null terminated
+ */
+const char* search_record(int id, int* len) {
+
+    const search_entry* e = id < nfile_records ? &file_records[id] : &session_records[id - nfile_records];
+
+    *len = e->len;
+    return e->text;
+}
+
+/**
+ * @brief Number of records searched, the next record to be added gets this id
+ */
+int search_records() {
+
+    update_index();
+    return nindexed;
+}
+
+void close_history_file() {
+
+    for (int i = 0; i < nsession_records; i++)
+        xfree((char*) session_records[i].text);
+    xfree(session_records);
+    xfree(file_records);
+
+    for (int i = 0; i < nbuckets; i++)
+        xfree(buckets[i].ids);
+    xfree(buckets);
+
+    if (file_text != NULL)
+        munmap((void*) file_text, file_size);
+    if (history_fd >= 0)
+        close(history_fd);
+}
+
+/**
+ * @brief Add the newest lines of the file to the input history, as many as fit in its memory
+ */
+static void load_newest_records() {
+
+    size_t start = file_size > (size_t) searchHistory.memory ? file_size - searchHistory.memory : 0;
+
+    // Go on to the start of a line
+    if (start > 0) {
+        const char* newline = memchr(file_text + start - 1, '\n', file_size - start + 1);
+        start = newline ? (size_t) (newline - file_text + 1) : file_size;
+    }
+
+    char line[MAX_IN + 1];
+
+    while (start < file_size) {
+
+        const char* newline = memchr(file_text + start, '\n', file_size - start);
+        size_t end = newline ? (size_t) (newline - file_text) : file_size;
+
+        if (end > start && end - start <= MAX_IN) {
+            memcpy(line, file_text + start, end - start);
+            line[end - start] = '\0';
+            add_to_history(&searchHistory, line);
+        }
+
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Split the whole file into records, skipping the lines that can't be inputs
+ */
+static void split_file() {
+
+    int nlines = 0;
+    for (const char* s = file_text; s < file_text + file_size; nlines++) {
+        const char* newline = memchr(s, '\n', file_text + file_size - s);
+        s = newline ? newline + 1 : file_text + file_size;
+    }
+
+    file_records = xmalloc((nlines ? nlines : 1) * sizeof(search_entry));
+    nfile_records = 0;
+
+    size_t start = 0;
+    while (start < file_size) {
+
+        const char* newline = memchr(file_text + start, '\n', file_size - start);
+        size_t end = newline ? (size_t) (newline - file_text) : file_size;
+
+        if (end > start && end - start <= MAX_IN)
+            file_records[nfile_records++] = (search_entry) { file_text + start, end - start };
+
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Index the records added since the last search (and split the file the first time)
+ */
+static void update_index() {
+
+    if (nfile_records < 0)
+        split_file();
+
+    for (; nindexed < nfile_records + nsession_records; nindexed++) {
+
+        int len;
+        const char* text = search_record(nindexed, &len);
+        index_record(nindexed, text, len);
+    }
+}
+
+static void index_record(int id, const char* text, int len) {
+
+    for (int i = 0; i < len; i++) {
+
+        unsigned char c = text[i];
+        char_seen[c / 8] |= 1 << c % 8;
+
+        if (i + 1 < len) {
+            int pair = c << 8 | (unsigned char) text[i+1];
+            pair_seen[pair / 8] |= 1 << pair % 8;
+        }
+
+        if (i + 3 <= len) {
+
+            trigram_postings* p = find_postings(trigram_key(text + i), 1);
+
+            // A trigram that appears more than once in the record is added once
+            if (p->size > 0 && p->ids[p->size - 1] == id)
+                continue;
+
+            if (p->size == p->max_size) {
+                p->max_size = p->max_size ? 2 * p->max_size : SEARCH_POSTINGS_SIZE;
+                p->ids = xrealloc(p->ids, p->max_size * sizeof(int));
+            }
+            p->ids[p->size++] = id;
+        }
+    }
+}
+
+/**
+ * @brief The postings of a trigram, which are added when *create* is set (otherwise NULL if there are none)
+ */
+static trigram_postings* find_postings(uint32_t key, int create) {
+
+    if (create && 2 * (nused_buckets + 1) > nbuckets)
+        grow_index();
+
+    if (nbuckets == 0)
+        return NULL;
+
+    // Open addressing with linear probing
+    for (uint32_t i = (key * 2654435761u) & (nbuckets - 1); ; i = (i + 1) & (nbuckets - 1)) {
+
+        if (buckets[i].key == key)
+            return &buckets[i];
+
+        if (buckets[i].key == 0) {
+
+            if (!create)
+                return NULL;
+
+            buckets[i].key = key;
+            nused_buckets++;
+            return &buckets[i];
+        }
+    }
+}
+
+static void grow_index() {
+
+    trigram_postings* old = buckets;
+    int nold = nbuckets;
+
+    nbuckets = nbuckets ? 2 * nbuckets : SEARCH_INDEX_BUCKETS;
+    buckets = xcalloc(nbuckets, sizeof(trigram_postings));
+    nused_buckets = 0;
+
+    for (int i = 0; i < nold; i++) {
+        if (old[i].key != 0)
+            *find_postings(old[i].key, 1) = old[i];
+    }
+
+    xfree(old);
+}
+
+static int contains_id(const trigram_postings* p, int id) {
+
+    int lo = 0, hi = p->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (p->ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < p->size && p->ids[lo] == id;
+}
+
+static uint32_t trigram_key(const char* s) {
+
+    return SEARCH_KEY_USED | (unsigned char) s[0] << 16 | (unsigned char) s[1] << 8 | (unsigned char) s[2];
+}
@@ -0,0 +1,139 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "cache.h"
+#include "history.h"
+#include "numberstack.h"
+#include "parser.h"
+#include "stats.h"
+#include "xmalloc.h"
+
+/*
+ * Runtime statistics (--stats, and the stats command in the interface)
+ *
+ * The allocation wrappers in xmalloc.c, evaluate(), the history and the numberstack update the
+ * counters of the thread they run in, which keeps them cheap. Batch workers add theirs to the
+ * totals with merge_stats() before they exit. The parse and evaluation timers are only read
+ * when statistics are shown, otherwise stats_clock() is always 0
+ */
+
+_Thread_local pcalc_stats stats;
+
+int stats_enabled = 0;
+int stats_timers_enabled = 0;
+
+// Counters of the batch workers that exited
+static pcalc_stats totals;
+static int total_tokens[2], total_parsers[2], total_trees[2], total_arena_blocks[2];
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_stats(pcalc_stats*, const pcalc_stats*);
+
+
+/**
+ * @brief Monotonic time in nanoseconds when the timers are enabled, 0 otherwise
+ */
+uint64_t stats_clock() {
+
+    if (!stats_timers_enabled)
+        return 0;
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/**
+ * @brief Add the counters of this thread to the totals (run by each batch worker before it exits)
+ */
+void merge_stats() {
+
+    pthread_mutex_lock(&totals_lock);
+
+    add_stats(&totals, &stats);
+
+    total_tokens[0] += total_tokens_created;
+    total_tokens[1] += total_tokens_freed;
+    total_parsers[0] += total_parsers_created;
+    total_parsers[1] += total_parsers_freed;
+    total_trees[0] += total_trees_created;
+    total_trees[1] += total_trees_freed;
+    total_arena_blocks[0] += total_arena_blocks_created;
+    total_arena_blocks[1] += total_arena_blocks_freed;
+
+    pthread_mutex_unlock(&totals_lock);
+}
+
+/**
+ * @brief Write the statistics of this thread and of the workers that exited, one line each
+ */
+void format_stats(char lines[STATS_LINES][STATS_LINE_SIZE]) {
+
+    pcalc_stats s = {0};
+
+    pthread_mutex_lock(&totals_lock);
+    add_stats(&s, &totals);
+    add_stats(&s, &stats);
+    pthread_mutex_unlock(&totals_lock);
+
+    snprintf(lines[0], STATS_LINE_SIZE, "Heap: %" PRId64 " bytes live, %" PRId64 " peak",
+            s.live_bytes, s.peak_live_bytes);
+
+    snprintf(lines[1], STATS_LINE_SIZE, "Allocations: %lu (%lu reallocations), %lu frees, %" PRIu64 " bytes",
+            s.allocations, s.reallocations, s.frees, s.requested_bytes);
+
+    snprintf(lines[2], STATS_LINE_SIZE, "Parse: %lu, %" PRIu64 " ns avg   Evaluate: %lu, %" PRIu64 " ns avg",
+            s.parses, s.parses ? s.parse_ns / s.parses : 0, s.evaluations, s.evaluations ? s.evaluate_ns / s.evaluations : 0);
+
+    snprintf(lines[3], STATS_LINE_SIZE, "History: %d records, peak %d   Stack: %d numbers, peak %d (%lu resizes)",
+            history.size, s.peak_history_size, numbers ? numbers->size : 0, s.peak_stack_size, s.stack_resizes);
+
+    snprintf(lines[4], STATS_LINE_SIZE, "Expression cache: %lu hits, %lu misses", cache_hits, cache_misses);
+
+    snprintf(lines[5], STATS_LINE_SIZE, "Created|freed: tokens %d|%d, parsers %d|%d, trees %d|%d, arena blocks %d|%d",
+            total_tokens[0] + total_tokens_created, total_tokens[1] + total_tokens_freed,
+            total_parsers[0] + total_parsers_created, total_parsers[1] + total_parsers_freed,
+            total_trees[0] + total_trees_created, total_trees[1] + total_trees_freed,
+            total_arena_blocks[0] + total_arena_blocks_created, total_arena_blocks[1] + total_arena_blocks_freed);
+}
+
+/**
+ * @brief Print the statistics to stderr
+ */
+void print_stats() {
+
+    char lines[STATS_LINES][STATS_LINE_SIZE];
+    format_stats(lines);
+
+    for (int i = 0; i < STATS_LINES; i++)
+        fprintf(stderr, "%s\n", lines[i]);
+}
+
+/**
+ * @brief Add the counters of *s* to *total*
+ *
+ * Live and peak bytes are added up, so with batch workers the peak is the sum of the peak of each
+ * thread. The history and the stack belong to one thread, so their peak is the largest one
+ */
+static void add_stats(pcalc_stats* total, const pcalc_stats* s) {
+
+    total->allocations += s->allocations;
+    total->reallocations += s->reallocations;
+    total->frees += s->frees;
+    total->requested_bytes += s->requested_bytes;
+    total->live_bytes += s->live_bytes;
+    total->peak_live_bytes += s->peak_live_bytes;
+    total->parses += s->parses;
+    total->parse_ns += s->parse_ns;
+    total->evaluations += s->evaluations;
+    total->evaluate_ns += s->evaluate_ns;
+    total->stack_resizes += s->stack_resizes;
+
+    if (s->peak_history_size > total->peak_history_size)
+        total->peak_history_size = s->peak_history_size;
+    if (s->peak_stack_size > total->peak_stack_size)
+        total->peak_stack_size = s->peak_stack_size;
+}
@@ -0,0 +1,925 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "format.h"
+#include "lexer.h"
+#include "operators.h"
+#include "wide.h"
+
+/*
+ * Numbers of more than 64 bits (the bit command up to WIDE_MAX_BITS)
+ *
+ * Everything works on the limbs of the current number of bits only, so a 128 bit number costs two
+ * limbs and not WIDE_LIMBS. The kernels leave the bits past the number of bits as they come out,
+ * and the caller masks the result with wide_mask(), like calculate() does with globalmask.
+ * Two limbs (up to 128 bits) are calculated as one unsigned __int128
+ */
+
+typedef unsigned __int128 uint128;
+
+static uint128 get128(const wide*);
+static void put128(wide*, uint128);
+static int significant_limbs(const uint64_t*, int);
+static uint64_t add_into(uint64_t*, int, const uint64_t*, int);
+static uint64_t subtract_from(uint64_t*, int, const uint64_t*, int);
+static void multiply_low(uint64_t*, const uint64_t*, const uint64_t*, int);
+static void multiply_full(uint64_t*, const uint64_t*, const uint64_t*, int);
+static uint64_t divide_small(uint64_t*, const uint64_t*, int, uint64_t);
+static void divide_limbs(uint64_t*, uint64_t*, const uint64_t*, const uint64_t*, int);
+static void shift_left(uint64_t*, const uint64_t*, int, unsigned);
+static void shift_right(uint64_t*, const uint64_t*, int, unsigned);
+static unsigned shift_amount(const wide*, int);
+static unsigned rotate_amount(const wide*, int);
+static int append_padded(char*, const char*, int, int, char);
+static void swap_in_limbs(wide*, const wide*, int, uint64_t (*)(uint64_t));
+static uint64_t limb_halfword_bytes(uint64_t);
+static uint64_t limb_word_bytes(uint64_t);
+static uint64_t limb_nibbles(uint64_t);
+static uint64_t limb_reverse_bits(uint64_t);
+static int bit_length(const wide*);
+
+
+/**
+ * @brief Number of limbs of the current number of bits
+ */
+int wide_limbs() {
+
+    return (globalmasksize + 63) / 64;
+}
+
+void wide_from_u64(wide* w, uint64_t value) {
+
+    w->limbs[0] = value;
+    memset(w->limbs + 1, 0, (wide_limbs() - 1) * sizeof(uint64_t));
+}
+
+void wide_copy(wide* dst, const wide* src) {
+
+    memcpy(dst->limbs, src->limbs, wide_limbs() * sizeof(uint64_t));
+}
+
+/**
+ * @brief Clear the bits past the current number of bits
+ */
+void wide_mask(wide* w) {
+
+    int bits = globalmasksize % 64;
+    if (bits)
+        w->limbs[wide_limbs() - 1] &= ~0ull >> (64 - bits);
+}
+
+/**
+ * @brief Clear the limbs a number of *masksize* bits didn't use, when the current number of bits is larger
+ */
+void wide_extend(wide* w, int masksize) {
+
+    for (int i = (masksize + 63) / 64; i < wide_limbs(); i++)
+        w->limbs[i] = 0;
+}
+
+int wide_is_zero(const wide* w) {
+
+    return significant_limbs(w->limbs, wide_limbs()) == 0;
+}
+
+int wide_fits_u64(const wide* w) {
+
+    return significant_limbs(w->limbs, wide_limbs()) <= 1;
+}
+
+/**
+ * @brief Decode the *len* digits of a literal in *base*, saturating when it doesn't fit in the limbs like the 64 bit literals do
+ */
+void wide_literal(const char* digits, int len, int base, wide* w) {
+
+    int n = wide_limbs();
+    memset(w->limbs, 0, n * sizeof(uint64_t));
+
+    for (int i = 0; i < len; i++) {
+
+        uint64_t carry = digit_value[(unsigned char) digits[i]];
+
+        for (int j = 0; j < n; j++) {
+            uint128 t = (uint128) w->limbs[j] * base + carry;
+            w->limbs[j] = t;
+            carry = t >> 64;
+        }
+
+        if (carry) {
+            memset(w->limbs, 0xff, n * sizeof(uint64_t));
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Unsigned decimal, into a buffer of at least WIDE_FORMAT_BUFFER_SIZE bytes
+ */
+int format_wide_decimal(char* buf, const wide* w) {
+
+    int n = wide_limbs();
+
+    uint64_t q[WIDE_LIMBS];
+    memcpy(q, w->limbs, n * sizeof(uint64_t));
+
+    // Groups of 19 digits (the most that fit in a limb), from the least significant one
+    uint64_t groups[WIDE_LIMBS + 2];
+    int ngroups = 0;
+
+    int m = significant_limbs(q, n);
+    do {
+        groups[ngroups++] = divide_small(q, q, m, 10000000000000000000ull);
+        m = significant_limbs(q, m);
+    } while (m > 0);
+
+    int len = format_decimal(buf, groups[ngroups - 1]);
+
+    for (int i = ngroups - 2; i >= 0; i--) {
+        char digits[FORMAT_BUFFER_SIZE];
+        len += append_padded(buf + len, digits, format_decimal(digits, groups[i]), 19, '0');
+    }
+
+    return len;
+}
+
+/**
+ * @brief Decimal of the value as a signed integer of the current number of bits
+ */
+int format_wide_signed_decimal(char* buf, const wide* w) {
+
+    int sign = globalmasksize - 1;
+    if (!(w->limbs[sign / 64] >> sign % 64 & 1))
+        return format_wide_decimal(buf, w);
+
+    wide negated;
+    wide_twos_complement(&negated, w, w);
+    wide_mask(&negated);
+
+    buf[0] = '-';
+    return format_wide_decimal(buf + 1, &negated) + 1;
+}
+
+/**
+ * @brief Hexadecimal without a prefix or leading zeros
+ */
+int format_wide_hex(char* buf, const wide* w, int uppercase) {
+
+    int m = significant_limbs(w->limbs, wide_limbs());
+    if (m == 0)
+        return format_hex(buf, 0, uppercase);
+
+    int len = format_hex(buf, w->limbs[m - 1], uppercase);
+
+    for (int i = m - 2; i >= 0; i--) {
+        char digits[FORMAT_BUFFER_SIZE];
+        len += append_padded(buf + len, digits, format_hex(digits, w->limbs[i], uppercase), 16, '0');
+    }
+
+    return len;
+}
+
+/**
+ * @brief The binary digits as shown in the binary pane, *nlines* lines of *bits_per_line* bits in groups of 8
+ *
+ * Each line is labeled with the number of bits up to its end, in 4 columns. When the number has
+ * more lines than that, the lines shown end with the one of the most significant set bit
+ */
+int format_wide_binary_pane(char* buf, const wide* w, int bits_per_line, int nlines) {
+
+    int nbits = globalmasksize;
+    int total = (nbits + bits_per_line - 1) / bits_per_line;
+
+    int m = significant_limbs(w->limbs, wide_limbs());
+    int top = m ? (64 * (m - 1) + 63 - __builtin_clzll(w->limbs[m - 1])) / bits_per_line : 0;
+
+    if (top < nlines - 1)
+        top = nlines - 1;
+    if (top > total - 1)
+        top = total - 1;
+
+    int len = 0;
+
+    for (int line = top; line > top - nlines && line >= 0; line--) {
+
+        int start = line * bits_per_line;
+        int end = start + bits_per_line < nbits ? start + bits_per_line : nbits;
+
+        if (line != top) {
+            memcpy(buf + len, "\n         ", 10);
+            len += 10;
+        }
+
+        char label[FORMAT_BUFFER_SIZE];
+        int labellen = format_decimal(label, end);
+        len += append_padded(buf + len, label, labellen, 4, ' ');
+        memcpy(buf + len, "  ", 2);
+        len += 2;
+
+        for (int bit = end - 1; bit >= start; bit--) {
+
+            buf[len++] = '0' + (w->limbs[bit / 64] >> bit % 64 & 1);
+
+            if (bit % 8 == 0 && bit > start)
+                buf[len++] = ' ';
+        }
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Leave out the middle of the *len* characters at *buf* so they take at most *width*, returns the new length
+ *
+ * The first and the last characters are kept, with "..." between them
+ */
+int elide_digits(char* buf, int len, int width) {
+
+    if (len <= width || width <= 3) {
+        buf[len] = '\0';
+        return len;
+    }
+
+    int tail = (width - 3) / 2;
+    int head = width - 3 - tail;
+
+    memcpy(buf + head, "...", 3);
+    memmove(buf + head + 3, buf + len - tail, tail);
+    buf[width] = '\0';
+
+    return width;
+}
+
+
+void wide_add(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    if (n == 2) {
+        put128(result, get128(a) + get128(b));
+        return;
+    }
+
+    uint128 carry = 0;
+    for (int i = 0; i < n; i++) {
+        carry += (uint128) a->limbs[i] + b->limbs[i];
+        result->limbs[i] = carry;
+        carry >>= 64;
+    }
+}
+
+// remember op1 = first popped ( right operand ), op2 = second popped ( left operand )
+void wide_subtract(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    if (n == 2) {
+        put128(result, get128(b) - get128(a));
+        return;
+    }
+
+    uint64_t borrow = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t x = b->limbs[i], y = a->limbs[i];
+        result->limbs[i] = x - y - borrow;
+        borrow = x < y || (x == y && borrow);
+    }
+}
+
+void wide_multiply(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    if (n == 2) {
+        put128(result, get128(a) * get128(b));
+        return;
+    }
+
+    // Only the limbs of the number of bits are calculated
+    uint64_t product[WIDE_LIMBS];
+    multiply_low(product, a->limbs, b->limbs, n);
+    memcpy(result->limbs, product, n * sizeof(uint64_t));
+}
+
+void wide_divide(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+
+    //TODO not divisible by 0
+    if (wide_is_zero(a)) {
+        wide_from_u64(result, 0);
+        return;
+    }
+
+    if (n == 2) {
+        put128(result, get128(b) / get128(a));
+        return;
+    }
+
+    uint64_t q[WIDE_LIMBS], r[WIDE_LIMBS];
+    divide_limbs(q, r, b->limbs, a->limbs, n);
+    memcpy(result->limbs, q, n * sizeof(uint64_t));
+}
+
+void wide_modulus(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+
+    //TODO not divisible by 0
+    if (wide_is_zero(a)) {
+        wide_from_u64(result, 0);
+        return;
+    }
+
+    if (n == 2) {
+        put128(result, get128(b) % get128(a));
+        return;
+    }
+
+    uint64_t q[WIDE_LIMBS], r[WIDE_LIMBS];
+    divide_limbs(q, r, b->limbs, a->limbs, n);
+    memcpy(result->limbs, r, n * sizeof(uint64_t));
+}
+
+void wide_and(wide* result, const wide* a, const wide* b) {
+
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        result->limbs[i] = a->limbs[i] & b->limbs[i];
+}
+
+void wide_or(wide* result, const wide* a, const wide* b) {
+
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        result->limbs[i] = a->limbs[i] | b->limbs[i];
+}
+
+void wide_nor(wide* result, const wide* a, const wide* b) {
+
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        result->limbs[i] = ~(a->limbs[i] | b->limbs[i]);
+}
+
+void wide_xor(wide* result, const wide* a, const wide* b) {
+
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        result->limbs[i] = a->limbs[i] ^ b->limbs[i];
+}
+
+void wide_shl(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+
+    // Shifts past the number of bits leave nothing
+    shift_left(result->limbs, b->limbs, n, shift_amount(a, n));
+}
+
+void wide_shr(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    shift_right(result->limbs, b->limbs, n, shift_amount(a, n));
+}
+
+void wide_rol(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    unsigned k = rotate_amount(a, n);
+
+    uint64_t left[WIDE_LIMBS], right[WIDE_LIMBS];
+    shift_left(left, b->limbs, n, k);
+    shift_right(right, b->limbs, n, globalmasksize - k);
+
+    for (int i = 0; i < n; i++)
+        result->limbs[i] = left[i] | right[i];
+}
+
+void wide_ror(wide* result, const wide* a, const wide* b) {
+
+    int n = wide_limbs();
+    unsigned k = rotate_amount(a, n);
+
+    uint64_t left[WIDE_LIMBS], right[WIDE_LIMBS];
+    shift_right(right, b->limbs, n, k);
+    shift_left(left, b->limbs, n, globalmasksize - k);
+
+    for (int i = 0; i < n; i++)
+        result->limbs[i] = left[i] | right[i];
+}
+
+void wide_not(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        result->limbs[i] = ~a->limbs[i];
+}
+
+void wide_twos_complement(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    // Inverted, plus one
+    uint64_t carry = 1;
+    for (int i = 0, n = wide_limbs(); i < n; i++) {
+        result->limbs[i] = ~a->limbs[i] + carry;
+        carry = carry && result->limbs[i] == 0;
+    }
+}
+
+/**
+ * @brief Reverse the order of the whole bytes of the number of bits, the bits after them stay where they are
+ */
+void wide_swap_endianness(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    int n = wide_limbs();
+    int nbytes = globalmasksize / 8;
+
+    uint64_t out[WIDE_LIMBS];
+    for (int i = 0; i < n; i++) {
+        int kept = 8 * nbytes - 64 * i;
+        out[i] = kept <= 0 ? a->limbs[i] : kept >= 64 ? 0 : a->limbs[i] & ~0ull << kept;
+    }
+
+    if (nbytes % 8 == 0) {
+        // Whole limbs, each one swapped in one instruction
+        for (int i = 0; i < nbytes / 8; i++)
+            out[i] = __builtin_bswap64(a->limbs[nbytes / 8 - 1 - i]);
+    }
+    else {
+        for (int k = 0; k < nbytes; k++) {
+            int to = nbytes - 1 - k;
+            out[to / 8] |= (a->limbs[k / 8] >> 8 * (k % 8) & 0xff) << 8 * (to % 8);
+        }
+    }
+
+    memcpy(result->limbs, out, n * sizeof(uint64_t));
+}
+
+void wide_swap_halfword_bytes(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    swap_in_limbs(result, a, 16, limb_halfword_bytes);
+}
+
+void wide_swap_word_bytes(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    swap_in_limbs(result, a, 32, limb_word_bytes);
+}
+
+void wide_swap_nibbles(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    swap_in_limbs(result, a, 8, limb_nibbles);
+}
+
+void wide_popcount(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    uint64_t count = 0;
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        count += __builtin_popcountll(a->limbs[i]);
+
+    wide_from_u64(result, count);
+}
+
+void wide_parity(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    uint64_t parity = 0;
+    for (int i = 0, n = wide_limbs(); i < n; i++)
+        parity ^= a->limbs[i];
+
+    wide_from_u64(result, __builtin_parityll(parity));
+}
+
+void wide_leading_zeros(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    wide_from_u64(result, globalmasksize - bit_length(a));
+}
+
+void wide_trailing_zeros(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    int n = wide_limbs();
+
+    int i = 0;
+    while (i < n && a->limbs[i] == 0)
+        i++;
+
+    wide_from_u64(result, i < n ? 64 * i + __builtin_ctzll(a->limbs[i]) : globalmasksize);
+}
+
+/**
+ * @brief Position of the highest bit set, or all ones (-1) if there's none, like the kernels of 64 bits or less
+ */
+void wide_log2_floor(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    int bits = bit_length(a);
+
+    if (bits)
+        wide_from_u64(result, bits - 1);
+    else
+        memset(result->limbs, 0xff, wide_limbs() * sizeof(uint64_t));
+}
+
+void wide_bit_reverse(wide* result, const wide* a, const wide* UNUSED(b)) {
+
+    int n = wide_limbs();
+
+    // Reversed limbs in reverse order, then the bits past the number of bits are shifted out
+    uint64_t out[WIDE_LIMBS];
+    for (int i = 0; i < n; i++)
+        out[i] = limb_reverse_bits(a->limbs[n - 1 - i]);
+
+    shift_right(result->limbs, out, n, 64 * n - globalmasksize);
+}
+
+/**
+ * @brief Extract the bits of *b* under the mask *a* to the low bits
+ *
+ * Every limb goes through the kernel of 64 bits, which uses PEXT if the CPU has it (see init_operations())
+ */
+void wide_bit_extract(wide* result, const wide* a, const wide* b) {
+
+    uint64_t (*extract)(uint64_t, uint64_t) = getopcode(EXTRACT_SYMBOL)->execute[KERNELS_64];
+
+    int n = wide_limbs();
+
+    uint64_t out[WIDE_LIMBS];
+    memset(out, 0, n * sizeof(uint64_t));
+
+    // The bits of each limb are put after the ones of the limbs below it, maybe across two limbs
+    int pos = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t bits = extract(a->limbs[i], b->limbs[i]);
+        out[pos / 64] |= bits << pos % 64;
+        if (pos % 64 && pos / 64 + 1 < n)
+            out[pos / 64 + 1] |= bits >> (64 - pos % 64);
+        pos += __builtin_popcountll(a->limbs[i]);
+    }
+
+    memcpy(result->limbs, out, n * sizeof(uint64_t));
+}
+
+/**
+ * @brief Deposit the low bits of *b* in the bits of the mask *a*
+ */
+void wide_bit_deposit(wide* result, const wide* a, const wide* b) {
+
+    uint64_t (*deposit)(uint64_t, uint64_t) = getopcode(DEPOSIT_SYMBOL)->execute[KERNELS_64];
+
+    int n = wide_limbs();
+
+    // Each limb of the mask takes the next bits of *b*, which may start in the middle of a limb
+    uint64_t out[WIDE_LIMBS];
+    int pos = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t bits = b->limbs[pos / 64] >> pos % 64;
+        if (pos % 64 && pos / 64 + 1 < n)
+            bits |= b->limbs[pos / 64 + 1] << (64 - pos % 64);
+        out[i] = deposit(a->limbs[i], bits);
+        pos += __builtin_popcountll(a->limbs[i]);
+    }
+
+    memcpy(result->limbs, out, n * sizeof(uint64_t));
+}
+
+
+static uint128 get128(const wide* w) {
+
+    return (uint128) w->limbs[1] << 64 | w->limbs[0];
+}
+
+static void put128(wide* w, uint128 value) {
+
+    w->limbs[0] = value;
+    w->limbs[1] = value >> 64;
+}
+
+/**
+ * @brief Number of limbs up to the most significant one that isn't zero
+ */
+static int significant_limbs(const uint64_t* limbs, int n) {
+
+    while (n > 0 && limbs[n - 1] == 0)
+        n--;
+
+    return n;
+}
+
+/**
+ * @brief Add the *xn* limbs of *x* to the *rn* limbs of *r*, returns the carry out of *r*
+ */
+static uint64_t add_into(uint64_t* r, int rn, const uint64_t* x, int xn) {
+
+    uint128 carry = 0;
+
+    for (int i = 0; i < rn && (i < xn || carry); i++) {
+        carry += (uint128) r[i] + (i < xn ? x[i] : 0);
+        r[i] = carry;
+        carry >>= 64;
+    }
+
+    return carry;
+}
+
+/**
+ * @brief Subtract the *xn* limbs of *x* from the *rn* limbs of *r*, returns the borrow out of *r*
+ */
+static uint64_t subtract_from(uint64_t* r, int rn, const uint64_t* x, int xn) {
+
+    uint64_t borrow = 0;
+
+    for (int i = 0; i < rn && (i < xn || borrow); i++) {
+        uint64_t y = i < xn ? x[i] : 0;
+        uint64_t d = r[i] - y - borrow;
+        borrow = r[i] < y || (r[i] == y && borrow);
+        r[i] = d;
+    }
+
+    return borrow;
+}
+
+/**
+ * @brief The lowest *n* limbs of the product of two numbers of *n* limbs
+ *
+ * With Karatsuba the low halves are multiplied whole, and the products of a low and a high half
+ * are only needed up to the *n* limbs, so they're the same problem again with fewer limbs
+ */
+static void multiply_low(uint64_t* r, const uint64_t* a, const uint64_t* b, int n) {
+
+    if (n < WIDE_KARATSUBA_LIMBS) {
+
+        memset(r, 0, n * sizeof(uint64_t));
+
+        for (int i = 0; i < n; i++) {
+
+            if (a[i] == 0)
+                continue;
+
+            uint64_t carry = 0;
+            for (int j = 0; i + j < n; j++) {
+                uint128 t = (uint128) a[i] * b[j] + r[i + j] + carry;
+                r[i + j] = t;
+                carry = t >> 64;
+            }
+        }
+
+        return;
+    }
+
+    int h = (n + 1) / 2;
+
+    uint64_t low[2 * WIDE_LIMBS], cross[WIDE_LIMBS];
+    multiply_full(low, a, b, h);
+    memcpy(r, low, n * sizeof(uint64_t));
+
+    multiply_low(cross, a, b + h, n - h);
+    add_into(r + h, n - h, cross, n - h);
+
+    multiply_low(cross, a + h, b, n - h);
+    add_into(r + h, n - h, cross, n - h);
+}
+
+/**
+ * @brief The 2 * *n* limbs of the product of two numbers of *n* limbs, with Karatsuba when they're long enough
+ */
+static void multiply_full(uint64_t* r, const uint64_t* a, const uint64_t* b, int n) {
+
+    if (n < WIDE_KARATSUBA_LIMBS) {
+
+        memset(r, 0, 2 * n * sizeof(uint64_t));
+
+        for (int i = 0; i < n; i++) {
+
+            if (a[i] == 0)
+                continue;
+
+            uint64_t carry = 0;
+            for (int j = 0; j < n; j++) {
+                uint128 t = (uint128) a[i] * b[j] + r[i + j] + carry;
+                r[i + j] = t;
+                carry = t >> 64;
+            }
+            r[i + n] = carry;
+        }
+
+        return;
+    }
+
+    // Low halves of h limbs and high halves of l limbs
+    int h = (n + 1) / 2, l = n - h;
+
+    // The products of the low halves and of the high halves go straight to their place in the result
+    multiply_full(r, a, b, h);
+    multiply_full(r + 2 * h, a + h, b + h, l);
+
+    // The middle is (a0 + a1) * (b0 + b1) minus both of them
+    uint64_t sa[WIDE_LIMBS + 2], sb[WIDE_LIMBS + 2], middle[2 * WIDE_LIMBS + 4];
+
+    memcpy(sa, a, h * sizeof(uint64_t));
+    sa[h] = add_into(sa, h, a + h, l);
+    memcpy(sb, b, h * sizeof(uint64_t));
+    sb[h] = add_into(sb, h, b + h, l);
+
+    multiply_full(middle, sa, sb, h + 1);
+    subtract_from(middle, 2 * h + 2, r, 2 * h);
+    subtract_from(middle, 2 * h + 2, r + 2 * h, 2 * l);
+
+    // The limbs of the middle that don't fit are zeros
+    add_into(r + h, 2 * n - h, middle, 2 * h + 2 < 2 * n - h ? 2 * h + 2 : 2 * n - h);
+}
+
+/**
+ * @brief Divide the *n* limbs of *u* by *d*, returns the remainder (*q* can be *u*)
+ */
+static uint64_t divide_small(uint64_t* q, const uint64_t* u, int n, uint64_t d) {
+
+    uint64_t r = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        uint128 t = (uint128) r << 64 | u[i];
+        q[i] = t / d;
+        r = t % d;
+    }
+
+    return r;
+}
+
+/**
+ * @brief Long division of the *n* limbs of *u* by those of *v*, which isn't zero
+ *
+ * Knuth's algorithm D (The Art of Computer Programming, vol. 2, 4.3.1): each limb of the quotient
+ * is estimated from the top two limbs of what's left and the top limb of the divisor, which is
+ * shifted until its top bit is set so the estimate is at most 2 too large
+ */
+static void divide_limbs(uint64_t* q, uint64_t* r, const uint64_t* u, const uint64_t* v, int n) {
+
+    int m = significant_limbs(u, n), d = significant_limbs(v, n);
+
+    memset(q, 0, n * sizeof(uint64_t));
+    memset(r, 0, n * sizeof(uint64_t));
+
+    if (m < d) {
+        memcpy(r, u, n * sizeof(uint64_t));
+        return;
+    }
+
+    if (d == 1) {
+        r[0] = divide_small(q, u, m, v[0]);
+        return;
+    }
+
+    int s = __builtin_clzll(v[d - 1]);
+
+    uint64_t vn[WIDE_LIMBS], un[WIDE_LIMBS + 1];
+    for (int i = d - 1; i > 0; i--)
+        vn[i] = v[i] << s | (s ? v[i - 1] >> (64 - s) : 0);
+    vn[0] = v[0] << s;
+
+    un[m] = s ? u[m - 1] >> (64 - s) : 0;
+    for (int i = m - 1; i > 0; i--)
+        un[i] = u[i] << s | (s ? u[i - 1] >> (64 - s) : 0);
+    un[0] = u[0] << s;
+
+    for (int j = m - d; j >= 0; j--) {
+
+        uint128 top = (uint128) un[j + d] << 64 | un[j + d - 1];
+        uint128 qhat = top / vn[d - 1];
+        uint128 rhat = top - qhat * vn[d - 1];
+
+        while (qhat >> 64 || qhat * vn[d - 2] > (rhat << 64 | un[j + d - 2])) {
+            qhat--;
+            rhat += vn[d - 1];
+            if (rhat >> 64)
+                break;
+        }
+
+        // Subtract qhat times the divisor from what's left
+        uint64_t carry = 0, borrow = 0;
+        for (int i = 0; i < d; i++) {
+            uint128 p = qhat * vn[i] + carry;
+            carry = p >> 64;
+
+            uint64_t x = un[i + j], y = p;
+            un[i + j] = x - y - borrow;
+            borrow = x < y || (x == y && borrow);
+        }
+
+        uint64_t x = un[j + d];
+        un[j + d] = x - carry - borrow;
+
+        // The estimate was one too large, add the divisor back
+        if (x < carry || (x == carry && borrow)) {
+            qhat--;
+            un[j + d] += add_into(un + j, d, vn, d);
+        }
+
+        q[j] = qhat;
+    }
+
+    // The remainder is what's left, shifted back
+    for (int i = 0; i < d; i++)
+        r[i] = un[i] >> s | (s ? un[i + 1] << (64 - s) : 0);
+}
+
+/**
+ * @brief Shift the *n* limbs of *x* left by *k* bits into *r* (which can be *x*)
+ */
+static void shift_left(uint64_t* r, const uint64_t* x, int n, unsigned k) {
+
+    int limbs = k / 64 < (unsigned) n ? (int) (k / 64) : n;
+    int bits = k % 64;
+
+    for (int i = n - 1; i >= 0; i--) {
+        uint64_t hi = i - limbs >= 0 ? x[i - limbs] << bits : 0;
+        uint64_t lo = bits && i - limbs - 1 >= 0 ? x[i - limbs - 1] >> (64 - bits) : 0;
+        r[i] = hi | lo;
+    }
+}
+
+/**
+ * @brief Shift the *n* limbs of *x* right by *k* bits into *r* (which can be *x*)
+ */
+static void shift_right(uint64_t* r, const uint64_t* x, int n, unsigned k) {
+
+    int limbs = k / 64 < (unsigned) n ? (int) (k / 64) : n;
+    int bits = k % 64;
+
+    for (int i = 0; i < n; i++) {
+        uint64_t lo = i + limbs < n ? x[i + limbs] >> bits : 0;
+        uint64_t hi = bits && i + limbs + 1 < n ? x[i + limbs + 1] << (64 - bits) : 0;
+        r[i] = lo | hi;
+    }
+}
+
+/**
+ * @brief Bits to shift by, anything past the *n* limbs is the same as all of them
+ */
+static unsigned shift_amount(const wide* a, int n) {
+
+    if (significant_limbs(a->limbs, n) > 1 || a->limbs[0] > (uint64_t) 64 * n)
+        return 64 * n;
+
+    return a->limbs[0];
+}
+
+/**
+ * @brief Bits to rotate by, modulo the number of bits
+ */
+static unsigned rotate_amount(const wide* a, int n) {
+
+    uint64_t q[WIDE_LIMBS];
+    return divide_small(q, a->limbs, n, globalmasksize);
+}
+
+/**
+ * @brief Write the *len* characters of *digits* at *buf* after as many *fill* as they need to take *width*, returns the characters written
+ */
+static int append_padded(char* buf, const char* digits, int len, int width, char fill) {
+
+    int pad = width > len ? width - len : 0;
+
+    memset(buf, fill, pad);
+    memcpy(buf + pad, digits, len);
+
+    return pad + len;
+}
+
+/**
+ * @brief Swap the parts of every unit of *unit* bits, which never cross a limb, with *swap*
+ *
+ * Like wide_swap_endianness(), the bits above the last whole unit are kept
+ */
+static void swap_in_limbs(wide* result, const wide* a, int unit, uint64_t (*swap)(uint64_t)) {
+
+    int swapped_bits = globalmasksize / unit * unit;
+
+    for (int i = 0; i < wide_limbs(); i++) {
+        int kept = swapped_bits - 64 * i;
+        uint64_t limb = a->limbs[i];
+        uint64_t mask = kept <= 0 ? 0 : kept >= 64 ? ~0ull : (1ull << kept) - 1;
+        result->limbs[i] = (swap(limb) & mask) | (limb & ~mask);
+    }
+}
+
+static uint64_t limb_halfword_bytes(uint64_t limb) {
+
+    return (limb & 0x00ff00ff00ff00ffull) << 8 | (limb >> 8 & 0x00ff00ff00ff00ffull);
+}
+
+static uint64_t limb_word_bytes(uint64_t limb) {
+
+    uint64_t swapped = __builtin_bswap64(limb);
+    return swapped << 32 | swapped >> 32;
+}
+
+static uint64_t limb_nibbles(uint64_t limb) {
+
+    return (limb & 0x0f0f0f0f0f0f0f0full) << 4 | (limb >> 4 & 0x0f0f0f0f0f0f0f0full);
+}
+
+static uint64_t limb_reverse_bits(uint64_t limb) {
+
+    limb = (limb & 0x5555555555555555ull) << 1 | (limb >> 1 & 0x5555555555555555ull);
+    limb = (limb & 0x3333333333333333ull) << 2 | (limb >> 2 & 0x3333333333333333ull);
+
+    return __builtin_bswap64(limb_nibbles(limb));
+}
+
+/**
+ * @brief Number of bits up to the highest one set, 0 for zero
+ */
+static int bit_length(const wide* a) {
+
+    int m = significant_limbs(a->limbs, wide_limbs());
+
+    return m ? 64 * m - __builtin_clzll(a->limbs[m - 1]) : 0;
+}
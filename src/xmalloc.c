@@ -1,6 +1,21 @@
 #include "xmalloc.h"
 
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define malloc_usable_size malloc_size
+#else
+#include <malloc.h>
+#endif
+#include <string.h>
+
 #include "global.h"
+#include "stats.h"
+
+_Thread_local int total_arena_blocks_created = 0;
+_Thread_local int total_arena_blocks_freed = 0;
+
+static arena_block* new_arena_block(size_t bytes);
+static void count_allocation(void* pntr, size_t bytes);
 
 
 /**
@@ -23,6 +38,7 @@ void* xmalloc_with_ressources(size_t bytes, void** ressources, size_t nres) {
         xfreen(ressources, nres);
         exit_pcalc(MEM_FAIL);
     }
+    count_allocation(temp, bytes);
     return temp;
 }
 
@@ -49,6 +65,7 @@ void* xcalloc_with_ressources(size_t nelem, size_t bytes, void** ressources, siz
         xfreen(ressources, nres);
         exit_pcalc(MEM_FAIL);
     }
+    count_allocation(temp, nelem * bytes);
     return temp;
 }
 
@@ -70,14 +87,31 @@ void* xrealloc(void *pntr, size_t bytes) {
  * @param npntrs is the amount of pointers to free = size of array
  */
 void* xrealloc_with_ressources(void* pntr, size_t bytes, void** ressources, size_t nres) {
-    void* temp = pntr ? realloc(pntr, bytes) : xmalloc(bytes);
+    if (pntr == NULL)
+        return xmalloc_with_ressources(bytes, ressources, nres);
+
+    size_t oldsize = malloc_usable_size(pntr);
+    void* temp = realloc(pntr, bytes);
     if (temp == NULL) {
         xfreen(ressources, nres);
         exit_pcalc(MEM_FAIL);
     }
+
+    stats.reallocations++;
+    stats.live_bytes -= oldsize;
+    count_allocation(temp, bytes);
     return (temp);
 }
 
+/**
+ * behaves the same as strdup but kills the program if malloc fails
+ * @param str string to copy
+ */
+char* xstrdup(const char* str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(xmalloc(len), str, len);
+}
+
 /**
  * Frees npntrs elements
  * @param pntrs is the list of pointers to free
@@ -94,5 +128,96 @@ void xfreen(void** pntrs, size_t npntrs) {
  * @param pntr the pointer to be freed
  */
 void xfree(void* pntr) {
+    if (pntr != NULL) {
+        stats.frees++;
+        stats.live_bytes -= malloc_usable_size(pntr);
+    }
     free(pntr);
 }
+
+static arena_block* new_arena_block(size_t bytes) {
+
+    size_t size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+    arena_block* block = xmalloc(sizeof(arena_block) + size);
+    total_arena_blocks_created++;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/**
+ * allocates from the arena, only getting a new block from the heap when the ones it has are full
+ * kills the program if the heap allocation fails
+ * @param a the arena
+ * @param bytes size of allocation
+ */
+void* arena_alloc(arena* a, size_t bytes) {
+
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    // Move on to the following blocks (kept from before the last reset) until one has enough room
+    while (a->current && a->current->used + bytes > a->current->size) {
+
+        if (a->current->next == NULL) {
+
+            a->current->next = new_arena_block(bytes);
+            a->current = a->current->next;
+        }
+        else {
+
+            a->current = a->current->next;
+            a->current->used = 0;
+        }
+    }
+
+    if (a->current == NULL)
+        a->first = a->current = new_arena_block(bytes);
+
+    void* pntr = a->current->data + a->current->used;
+    a->current->used += bytes;
+    return pntr;
+}
+
+/**
+ * releases everything allocated from the arena in O(1), keeping its blocks to be reused
+ * @param a the arena
+ */
+void arena_reset(arena* a) {
+
+    a->current = a->first;
+    if (a->current)
+        a->current->used = 0;
+}
+
+/**
+ * gives all the blocks of the arena back to the heap
+ * @param a the arena
+ */
+void free_arena(arena* a) {
+
+    while (a->first) {
+        arena_block* next = a->first->next;
+        xfree(a->first);
+        total_arena_blocks_freed++;
+        a->first = next;
+    }
+
+    a->current = NULL;
+}
+
+/**
+ * counts an allocation in the statistics of the thread
+ * @param pntr the memory allocated
+ * @param bytes size asked for
+ */
+static void count_allocation(void* pntr, size_t bytes) {
+
+    stats.allocations++;
+    stats.requested_bytes += bytes;
+    stats.live_bytes += malloc_usable_size(pntr);
+
+    if (stats.live_bytes > stats.peak_live_bytes)
+        stats.peak_live_bytes = stats.live_bytes;
+}